@@ -12,29 +12,108 @@
  */
 
 #include "dma.h"
+#include "kdebug.h"
 #include "mem_map.h"
+#include "mem_utils.h"
+#include "perf.h"
+#include "sys.h"
 #include "vdp.h"
 #include "z80.h"
 
 /**
- * \brief            Define a DMA queue command operation
+ * \brief           Biggest queued command size in words, its bytes must fit in the 16 bits budget counters
  */
-typedef struct smd_dma_queue_cmd_t {
-    uint16_t autoinc;           /**< Autoincrement register in bytes */
-    uint16_t length_h;          /**< Length register (high) in words */
-    uint16_t length_l;          /**< Length register (low) in words */
-    uint16_t addr_h;            /**< Source address register (high) in words */
-    uint16_t addr_m;            /**< Source address register (middle) in words */
-    uint16_t addr_l;            /**< Source address register (low) in words */
-    uint16_t ctrl_addr_h;       /**< VDP command with the destination address */
-    uint16_t ctrl_addr_l;       /**< VDP command (low). Start transfer */
-} smd_dma_queue_cmd_t;
+#define SMD_DMA_QUEUE_CMD_WORDS_MAX (0x7FFF)
 
 /**
- * \brief           DMA command queue and position index
+ * \brief           Last queued transfer information used to coalesce new ones
  */
-static smd_dma_queue_cmd_t smd_dma_queue[SMD_DMA_QUEUE_SIZE];
-static uint16_t smd_dma_queue_index;
+typedef struct smd_dma_queue_tail_t {
+    smd_dma_queue_cmd_t *cmd;       /**< Last queued command, nullptr if can't be extended */
+    uint32_t src_end;               /**< Source address after the last transfer */
+    uint32_t src_block;             /**< 128kB block of the transfer source */
+    uint16_t dest_end;              /**< Destination address after the last transfer */
+    uint16_t size;                  /**< Command total size in words */
+    uint16_t inc;                   /**< Command write position increment */
+    uint16_t priority;              /**< Command priority */
+    smd_dma_transfer_type_t type;   /**< Command transfer type */
+} smd_dma_queue_tail_t;
+
+/**
+ * \brief           DMA command queue
+ */
+typedef struct smd_dma_queue_t {
+    smd_dma_queue_cmd_t cmds[SMD_DMA_QUEUE_SIZE];   /**< Queued commands */
+    uint16_t index;                 /**< Position index (amount of queued commands) */
+    uint32_t normal_bytes;          /**< Total bytes of the normal priority commands */
+    uint16_t coalesced;             /**< Transfers merged into commands since the last flush */
+    smd_dma_queue_tail_t tail;      /**< Last queued command used to coalesce new ones */
+} smd_dma_queue_t;
+
+/**
+ * \brief           DMA command queues
+ *
+ * Transfers are always enqueued in the back queue. In auto flush mode, the
+ * vertical blank interrupt executes the front queue while the back one is being
+ * filled, and both are swapped with smd_dma_queue_swap.
+ */
+static smd_dma_queue_t smd_dma_queues[2];
+static smd_dma_queue_t *smd_dma_queue;
+static smd_dma_queue_t *smd_dma_queue_front;
+
+/**
+ * \brief           Is the front queue executed from the vertical blank interrupt?
+ */
+static volatile bool smd_dma_queue_auto_flush;
+
+/**
+ * \brief           DMA staging ring buffer, read (tail) and write (head) positions
+ *
+ * It lives in work RAM, which is a single 64kB block, so staged transfers never
+ * cross a 128kB boundary. Used bytes go from tail to head, wrapping at the end.
+ */
+alignas(4) static uint8_t smd_dma_staging[SMD_DMA_STAGING_SIZE];
+static uint16_t smd_dma_staging_head;
+static volatile uint16_t smd_dma_staging_tail;
+
+/**
+ * \brief           Staged transfers dropped since the last flush
+ */
+static uint16_t smd_dma_staging_overflows;
+
+/**
+ * \brief           Running DMA streams
+ */
+static smd_dma_stream_t *smd_dma_streams[SMD_DMA_STREAM_MAX];
+
+/**
+ * \brief           Amount of queue executions, used to know when streams end
+ */
+static volatile uint16_t smd_dma_flush_count;
+
+/**
+ * \brief           Queue generations, used to know when critical commands end
+ *
+ * Commands enqueued between two flushes (or swaps in auto flush mode) belong to
+ * the back queue generation. Critical commands are never deferred, so the done
+ * generation is the last one whose critical commands have been executed, no
+ * matter the normal or deferrable ones carried over by the budget. The front
+ * pending flag is set while swapped commands wait for the vertical blank.
+ */
+static uint16_t smd_dma_queue_gen;
+static uint16_t smd_dma_queue_front_gen;
+static volatile uint16_t smd_dma_queue_done_gen;
+static volatile bool smd_dma_queue_front_pending;
+
+/**
+ * \brief           Bytes that can be transferred on each queue flush
+ */
+static uint16_t smd_dma_budget;
+
+/**
+ * \brief           Last queue flush statistics
+ */
+static smd_dma_stats_t smd_dma_stats;
 
 /**
  * \brief           Build a VDP ctrl port write address set command
@@ -47,57 +126,494 @@ smd_dma_ctrl_addr_build(const smd_dma_transfer_type_t xram_addr, const uint32_t
     return (((uint32_t)(xram_addr)) | (((uint32_t)(dest) & 0x3FFF) << 16) | ((uint32_t)(dest) >> 14));
 }
 
+/**
+ * \brief           Write a transfer to the VDP using the CPU instead of DMA
+ * \param[in]       transfer: Transfer configuration
+ */
+static inline void
+smd_dma_cpu_write(const smd_dma_transfer_t *restrict transfer) {
+    const uint16_t *src = transfer->src;
+    uint16_t sr;
+
+    /* Prevent VDP corruption waiting for a running DMA copy/fill operation */
+    smd_dma_wait();
+
+    /* An interrupt using the VDP would change the write address */
+    sr = smd_sys_ints_save();
+    smd_vdp_reg_set(SMD_VDP_REG_AUTOINC, transfer->inc);
+    /* The write command is the DMA one without the DMA flag */
+    *SMD_VDP_CTRL_PORT_U32 = smd_dma_ctrl_addr_build(transfer->type, transfer->dest) & ~0x80;
+    for (uint16_t i = 0; i < transfer->size; ++i) {
+        *SMD_VDP_DATA_PORT_U16 = src[i];
+    }
+    smd_sys_ints_restore(sr);
+}
+
 inline void
 smd_dma_init(void) {
-    smd_dma_queue_index = 0;
+    smd_dma_queue_auto_flush = false;
+    smd_dma_queue = &smd_dma_queues[0];
+    smd_dma_queue_front = &smd_dma_queues[1];
+    for (uint16_t i = 0; i < 2; ++i) {
+        smd_dma_queues[i].index = 0;
+        smd_dma_queues[i].normal_bytes = 0;
+        smd_dma_queues[i].coalesced = 0;
+        smd_dma_queues[i].tail.cmd = nullptr;
+    }
+    smd_dma_staging_head = 0;
+    smd_dma_staging_tail = 0;
+    smd_dma_staging_overflows = 0;
+    for (uint16_t i = 0; i < SMD_DMA_STREAM_MAX; ++i) {
+        smd_dma_streams[i] = nullptr;
+    }
+    smd_dma_flush_count = 0;
+    smd_dma_queue_gen = 1;
+    smd_dma_queue_front_gen = 0;
+    smd_dma_queue_done_gen = 0;
+    smd_dma_queue_front_pending = false;
+    smd_dma_stats = (smd_dma_stats_t) {0};
+    smd_dma_budget_reset();
 }
 
 inline void
 smd_dma_wait(void) {
-    /* Checks the DMA in progress flag in status register */
-    while (*SMD_VDP_CTRL_PORT_U32 & 0x10) {
+    /* Checks the DMA in progress flag (bit 1) in status register */
+    while (*SMD_VDP_CTRL_PORT_U16 & 0x02) {
         __asm__ volatile("\tnop\n");
     }
 }
 
 inline uint16_t
 smd_dma_queue_size(void) {
-    return smd_dma_queue_index;
+    return smd_dma_queue->index;
+}
+
+/**
+ * \brief           Release the staging ring memory of the already executed transfers
+ *
+ * Staged data is allocated in queue order, so the oldest staged command still
+ * pending in the queues (front first) marks where the used ring starts.
+ */
+static void
+smd_dma_staging_release(void) {
+    smd_dma_queue_t *queue = smd_dma_queue_front;
+
+    for (uint16_t q = 0; q < 2; ++q) {
+        for (uint16_t i = 0; i < queue->index; ++i) {
+            if (queue->cmds[i].staging) {
+                smd_dma_staging_tail = queue->cmds[i].staging - 1;
+                return;
+            }
+        }
+        queue = smd_dma_queue;
+    }
+    /* Nothing pending, the whole ring is free */
+    smd_dma_staging_tail = smd_dma_staging_head;
 }
 
 inline void
 smd_dma_queue_clear(void) {
-    smd_dma_queue_index = 0;
+    smd_dma_queue->index = 0;
+    smd_dma_queue->normal_bytes = 0;
+    smd_dma_queue->tail.cmd = nullptr;
+    smd_dma_staging_release();
+}
+
+/**
+ * \brief           Issue a DMA command to the VDP
+ * \param[in]       cmd: DMA command to issue. It can be in RAM or ROM
+ * \note            The z80 bus must be requested before issuing a transfer
+ */
+static inline void
+smd_dma_cmd_issue(const smd_dma_queue_cmd_t *restrict cmd) {
+    const uint32_t *cmd_p = (const uint32_t *) cmd;
+    /* Used to issue the dma from a ram space */
+    volatile uint16_t start;
+    /* The H interrupt (raster, blanked lines) can come even from the vblank */
+    const uint16_t sr = smd_sys_ints_save();
+
+    /* Tiny writes are done by the CPU with the data stored in the command */
+    if (cmd->op == SMD_DMA_QUEUE_OP_WRITE) {
+        smd_vdp_reg_set(SMD_VDP_REG_AUTOINC, cmd->autoinc & 0xFF);
+        *SMD_VDP_CTRL_PORT_U32 = *(const uint32_t *) &(cmd->ctrl_addr_h);
+        for (uint16_t i = 0; i < (cmd->bytes >> 1); ++i) {
+            *SMD_VDP_DATA_PORT_U16 = cmd->data[i];
+        }
+        smd_sys_ints_restore(sr);
+        return;
+    }
+
+    /*
+     * Sets the autoincrement on word writes and the high part of the DMA
+     * size in words
+     */
+    *SMD_VDP_CTRL_PORT_U32 = *cmd_p;
+    smd_vdp_reg_sync(cmd->autoinc);
+    ++cmd_p;
+    /*
+     * Sets the low part of the DMA size in words and the high part of
+     * source address
+     */
+    *SMD_VDP_CTRL_PORT_U32 = *cmd_p;
+    ++cmd_p;
+    /* Sets the middle and low part of the DMA source address */
+    *SMD_VDP_CTRL_PORT_U32 = *cmd_p;
+    /*
+     * Issues the DMA from ram space and in words (see SEGA notes on DMA). The
+     * command can be in ROM, so its last word is copied to ram first
+     */
+    start = cmd->ctrl_addr_l;
+    *SMD_VDP_CTRL_PORT_U16 = cmd->ctrl_addr_h;
+    *SMD_VDP_CTRL_PORT_U16 = start;
+    /* Copies and fills don't stop the m68k, wait before using the VDP again */
+    if (cmd->op != SMD_DMA_QUEUE_OP_TRANSFER) {
+        if (cmd->op == SMD_DMA_QUEUE_OP_FILL) {
+            *SMD_VDP_DATA_PORT_U16 = cmd->fill_value;
+        }
+        smd_dma_wait();
+    }
+    smd_sys_ints_restore(sr);
+}
+
+/**
+ * \brief           Issue all the commands of a DMA script, without budget checks
+ * \param[in]       script: DMA commands to issue
+ * \param[in]       count: Amount of commands in the script
+ * \note            The z80 bus must be requested before
+ */
+static inline void
+smd_dma_script_execute(const smd_dma_queue_cmd_t *restrict script, uint16_t count) {
+    smd_dma_queue_cmd_t cmd;
+    uint32_t src;
+
+    while (count) {
+        if (script->op == SMD_DMA_QUEUE_OP_TRANSFER) {
+            /* Transfer sources are pointers, split them into the source registers now */
+            cmd = *script;
+            src = (uint32_t) script->src;
+            cmd.addr_h = SMD_VDP_REG_DMASRC_H | ((src >> 17) & 0x7F);
+            cmd.addr_m = SMD_VDP_REG_DMASRC_M | ((src >> 9) & 0xFF);
+            cmd.addr_l = SMD_VDP_REG_DMASRC_L | ((src >> 1) & 0xFF);
+            smd_dma_cmd_issue(&cmd);
+        } else {
+            smd_dma_cmd_issue(script);
+        }
+        ++script;
+        --count;
+    }
+}
+
+/**
+ * \brief           Execute the commands of a queue that fit in the budget
+ * \param[in]       queue: DMA command queue to execute
+ * \note            Not executed commands are kept in the queue in order
+ */
+static void
+smd_dma_queue_execute(smd_dma_queue_t *queue) {
+    smd_dma_queue_cmd_t *cmd = queue->cmds;
+    smd_dma_queue_cmd_t *deferred = queue->cmds;
+    uint16_t budget = smd_dma_budget;
+    /* Normal priority bytes still pending in the queue (the next flush ones) */
+    uint32_t normal_pending = queue->normal_bytes;
+    /* Once a command of a priority doesn't fit, the following ones must wait */
+    bool normal_blocked = false;
+    bool deferrable_blocked = false;
+    bool blocked;
+    /*
+     * No normal or deferrable command executed yet. A command bigger than the
+     * whole budget is only executed in this case, alone, to avoid starving it.
+     */
+    bool fresh = true;
+    bool oversized;
+
+    smd_dma_stats = (smd_dma_stats_t) {0};
+    smd_dma_stats.coalesced_cmds = queue->coalesced;
+    smd_dma_stats.staging_overflows = smd_dma_staging_overflows;
+    smd_dma_staging_overflows = 0;
+    queue->coalesced = 0;
+    queue->normal_bytes = 0;
+    /* Deferred commands are moved, so they can't be extended anymore */
+    queue->tail.cmd = nullptr;
+
+    smd_z80_bus_request_fast();
+    for (uint16_t i = 0; i < queue->index; ++i, ++cmd) {
+        oversized = fresh && (cmd->bytes > smd_dma_budget);
+        if (cmd->priority == SMD_DMA_PRIORITY_NORMAL) {
+            normal_blocked = normal_blocked || ((cmd->bytes > budget) && !oversized);
+            blocked = normal_blocked;
+            normal_pending -= cmd->bytes;
+            if (blocked) {
+                queue->normal_bytes += cmd->bytes;
+            }
+        } else if (cmd->priority == SMD_DMA_PRIORITY_DEFERRABLE) {
+            /* Deferrable commands only use the budget left by normal ones */
+            deferrable_blocked = deferrable_blocked || normal_blocked
+                                 || ((cmd->bytes + normal_pending > budget) && !(oversized && !normal_pending));
+            blocked = deferrable_blocked;
+        } else {
+            blocked = false;
+        }
+        if (!blocked && cmd->priority != SMD_DMA_PRIORITY_CRITICAL) {
+            fresh = false;
+        }
+        if (blocked) {
+            /* Keep the command for the next flush preserving the order */
+            *deferred = *cmd;
+            ++deferred;
+            smd_dma_stats.deferred_bytes += cmd->bytes;
+            ++smd_dma_stats.deferred_cmds;
+            continue;
+        }
+        budget = (cmd->bytes > budget) ? 0 : budget - cmd->bytes;
+        smd_dma_stats.flushed_bytes += cmd->bytes;
+        ++smd_dma_stats.flushed_cmds;
+
+        if (cmd->op == SMD_DMA_QUEUE_OP_SCRIPT) {
+            smd_dma_script_execute(*((const smd_dma_queue_cmd_t **) &(cmd->ctrl_addr_h)), cmd->length_l);
+        } else {
+            smd_dma_cmd_issue(cmd);
+        }
+    }
+    smd_z80_bus_release();
+    /*
+     * Status register bit 3 is set on the vertical blank and while the display
+     * is off. A flush that issued nothing can't overrun it.
+     */
+    smd_dma_stats.vblank_overrun = (smd_dma_stats.flushed_cmds > 0) && !(*SMD_VDP_CTRL_PORT_U16 & 0x08);
+    if (smd_dma_stats.vblank_overrun) {
+        smd_perf_dma_overrun_add();
+    }
+    queue->index = deferred - queue->cmds;
+    smd_dma_staging_release();
+    ++smd_dma_flush_count;
+}
+
+/**
+ * \brief           Finish the DMA streams whose last slice has been executed
+ * \note            Callbacks are called from here
+ */
+static void
+smd_dma_streams_complete(void) {
+    smd_dma_stream_t *stream;
+
+    for (uint16_t i = 0; i < SMD_DMA_STREAM_MAX; ++i) {
+        stream = smd_dma_streams[i];
+        if (stream != nullptr && stream->size == 0
+            && (int16_t) (smd_dma_flush_count - stream->done_flush) >= 0) {
+            smd_dma_streams[i] = nullptr;
+            stream->done = true;
+            if (stream->callback != nullptr) {
+                stream->callback(stream);
+            }
+        }
+    }
+}
+
+/**
+ * \brief           Enqueue the next slice of each running DMA stream
+ *
+ * Slices use the budget left by the commands already waiting in the queues for
+ * the next execution. Deferrable commands don't count, they yield to streams.
+ */
+static void
+smd_dma_streams_feed(void) {
+    smd_dma_stream_t *stream;
+    smd_dma_queue_t *queue;
+    uint32_t pending = 0;
+    uint16_t front;
+    uint16_t slice;
+
+    /* Bytes the next queue execution will spend before the streams */
+    queue = smd_dma_queue_auto_flush ? smd_dma_queue_front : smd_dma_queue;
+    for (uint16_t q = 0; q < 2; ++q) {
+        for (uint16_t i = 0; i < queue->index; ++i) {
+            if (queue->cmds[i].priority != SMD_DMA_PRIORITY_DEFERRABLE) {
+                pending += queue->cmds[i].bytes;
+            }
+        }
+        if (!smd_dma_queue_auto_flush) {
+            break;
+        }
+        queue = smd_dma_queue;
+    }
+
+    /*
+     * In auto flush mode the swap appends the back queue to the deferred front
+     * commands only as far as they fit. A slice left in the back queue wouldn't
+     * be executed in the next flush, so slices are only fed when all the back
+     * queue fits in the front one.
+     */
+    front = smd_dma_queue_auto_flush ? smd_dma_queue_front->index : 0;
+    for (uint16_t i = 0; i < SMD_DMA_STREAM_MAX; ++i) {
+        stream = smd_dma_streams[i];
+        /* A slice can need two queue slots when it crosses 128kB */
+        if (stream == nullptr || stream->size == 0 || pending >= smd_dma_budget
+            || front + smd_dma_queue->index + 2 > SMD_DMA_QUEUE_SIZE) {
+            continue;
+        }
+        slice = (smd_dma_budget - pending) >> 1;
+        if (slice > stream->size) {
+            slice = stream->size;
+        }
+        smd_dma_transfer_enqueue( &(smd_dma_transfer_t) {
+            .type = stream->type,
+            .src = (void *) stream->src,
+            .dest = stream->dest,
+            .size = slice,
+            .inc = stream->inc,
+            .priority = SMD_DMA_PRIORITY_CRITICAL
+        });
+        pending += slice << 1;
+        stream->src += slice << 1;
+        stream->dest += slice * stream->inc;
+        stream->size -= slice;
+        /* The slice is executed in the next queue execution */
+        stream->done_flush = smd_dma_flush_count + 1;
+    }
 }
 
 void
 smd_dma_queue_flush(void) {
-    uint32_t *queue_p = (uint32_t *) smd_dma_queue;
+    smd_dma_streams_feed();
+    smd_dma_queue_execute(smd_dma_queue);
+    /* Older generations can still wait in the front queue in auto flush mode */
+    if (!smd_dma_queue_front_pending) {
+        smd_dma_queue_done_gen = smd_dma_queue_gen;
+    }
+    ++smd_dma_queue_gen;
+    smd_dma_streams_complete();
+}
 
-    smd_z80_bus_request_fast();
-    for (uint16_t i = 0; i < smd_dma_queue_index; ++i) {
-        /*
-         * Sets the autoincrement on word writes and the high part of the DMA
-         * size in words
-         */
-        *SMD_VDP_CTRL_PORT_U32 = *queue_p;
-        ++queue_p;
+void
+smd_dma_queue_swap(void) {
+    smd_dma_queue_t *queue;
+    smd_dma_queue_cmd_t *cmd;
+    uint16_t count;
+    bool ints_enabled;
+
+    /* Streams finished in the previous vertical blanks */
+    smd_dma_streams_complete();
+
+    /* The vertical blank interrupt must not see the queues half swapped */
+    ints_enabled = smd_sys_ints_status();
+    smd_sys_ints_disable();
+
+    smd_dma_streams_feed();
+
+    if (smd_dma_queue_front->index == 0) {
+        /* The usual case, the front queue was completely executed */
+        queue = smd_dma_queue_front;
+        smd_dma_queue_front = smd_dma_queue;
+        smd_dma_queue = queue;
+    } else {
         /*
-         * Sets the low part of the DMA size in words and the high part of
-         * source address
+         * The front queue has deferred commands which must be executed before
+         * the new ones, so the back queue is appended to it as far as possible
          */
-        *SMD_VDP_CTRL_PORT_U32 = *queue_p;
-        ++queue_p;
-        /* Sets the middle and low part of the DMA source address */
-        *SMD_VDP_CTRL_PORT_U32 = *queue_p;
-        ++queue_p;
-        /* Issues the DMA from ram space and in words (see SEGA notes on DMA) */
-        *SMD_VDP_CTRL_PORT_U16 = *queue_p >> 16;
-        *SMD_VDP_CTRL_PORT_U16 = *queue_p;
-        ++queue_p;
+        count = SMD_DMA_QUEUE_SIZE - smd_dma_queue_front->index;
+        if (count > smd_dma_queue->index) {
+            count = smd_dma_queue->index;
+        }
+        cmd = smd_dma_queue->cmds;
+        for (uint16_t i = 0; i < count; ++i, ++cmd) {
+            if (cmd->priority == SMD_DMA_PRIORITY_NORMAL) {
+                smd_dma_queue_front->normal_bytes += cmd->bytes;
+                smd_dma_queue->normal_bytes -= cmd->bytes;
+            }
+            smd_dma_queue_front->cmds[smd_dma_queue_front->index] = *cmd;
+            ++smd_dma_queue_front->index;
+        }
+        smd_dma_queue_front->coalesced += smd_dma_queue->coalesced;
+        /* Commands that didn't fit stay in the back queue for the next swap */
+        smd_dma_queue->index -= count;
+        for (uint16_t i = 0; i < smd_dma_queue->index; ++i) {
+            smd_dma_queue->cmds[i] = smd_dma_queue->cmds[count + i];
+        }
+        smd_dma_queue->coalesced = 0;
     }
-    smd_z80_bus_release();
-    smd_dma_queue_clear();
+    /* The back queue commands have been moved, so they can't be extended */
+    smd_dma_queue->tail.cmd = nullptr;
+    smd_dma_queue_front->tail.cmd = nullptr;
+    if (smd_dma_queue->index == 0) {
+        smd_dma_queue->normal_bytes = 0;
+        /* The whole back queue generation is executed by the next flush */
+        smd_dma_queue_front_gen = smd_dma_queue_gen;
+        ++smd_dma_queue_gen;
+    }
+    smd_dma_queue_front_pending = true;
+
+    if (ints_enabled) {
+        smd_sys_ints_enable();
+    }
+}
+
+void
+smd_dma_queue_vblank_flush(void) {
+    if (smd_dma_queue_auto_flush) {
+        smd_dma_queue_execute(smd_dma_queue_front);
+        /* Only deferred normal and deferrable commands are left in the front queue */
+        smd_dma_queue_done_gen = smd_dma_queue_front_gen;
+        smd_dma_queue_front_pending = false;
+    }
+}
+
+inline void
+smd_dma_queue_auto_flush_set(const bool enabled) {
+    smd_dma_queue_auto_flush = enabled;
+    /* Blanked lines are only part of the budget in auto flush mode */
+    smd_dma_budget_reset();
+}
+
+inline bool
+smd_dma_queue_auto_flush_get(void) {
+    return smd_dma_queue_auto_flush;
+}
+
+inline uint16_t
+smd_dma_budget_get(void) {
+    return smd_dma_budget;
+}
+
+inline void
+smd_dma_budget_set(const uint16_t bytes) {
+    smd_dma_budget = bytes;
+}
+
+void
+smd_dma_budget_reset(void) {
+    uint16_t lines;
+
+    /* Vertical blank lines depend on the video system and the display height */
+    if (!smd_sys_is_pal()) {
+        lines = SMD_DMA_VBLANK_LINES_NTSC_V28;
+    } else {
+        lines = (smd_vdp_screen_height_get() == 240) ? SMD_DMA_VBLANK_LINES_PAL_V30 : SMD_DMA_VBLANK_LINES_PAL_V28;
+    }
+    /*
+     * Lines blanked around the vertical blank are DMA speed lines too, but only
+     * the auto flush runs on them. Manual flushes come after the bottom lines
+     * and the top ones belong to the next frame.
+     */
+    if (smd_dma_queue_auto_flush) {
+        lines += smd_vdp_blank_lines_get();
+    }
+    smd_dma_budget = (lines - SMD_DMA_BUDGET_MARGIN_LINES)
+                     * (smd_vdp_is_h40() ? SMD_DMA_VBLANK_LINE_BYTES_H40 : SMD_DMA_VBLANK_LINE_BYTES_H32);
+}
+
+inline const smd_dma_stats_t *
+smd_dma_stats_get(void) {
+    return &smd_dma_stats;
+}
+
+inline uint16_t
+smd_dma_queue_sync_get(void) {
+    return smd_dma_queue_gen;
+}
+
+inline bool
+smd_dma_queue_sync_done(const uint16_t sync) {
+    return (int16_t) (smd_dma_queue_done_gen - sync) >= 0;
 }
 
 void
@@ -145,12 +661,21 @@ smd_dma_transfer_fast(const smd_dma_transfer_t *restrict transfer) {
     /* Used to issue the dma from a ram space */
     volatile uint32_t cmd;
     uint16_t *cmd_p = (uint16_t *) &cmd;
+    uint16_t sr;
+
+    /* DMA setup costs more than writing a few words */
+    if (transfer->size <= SMD_DMA_CPU_WRITE_THRESHOLD) {
+        smd_dma_cpu_write(transfer);
+        return;
+    }
 
     /* Prevent VDP corruption waiting for a running DMA copy/fill operation */
     smd_dma_wait();
 
+    /* An interrupt using the VDP would change the DMA registers or split the command */
+    sr = smd_sys_ints_save();
     /* Sets the autoincrement on word writes */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_AUTOINC | transfer->inc;
+    smd_vdp_reg_set(SMD_VDP_REG_AUTOINC, transfer->inc);
     /* Sets the DMA size in words */
     *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMALEN_L | (transfer->size & 0xFF);
     *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMALEN_H | ((transfer->size >> 8) & 0xFF);
@@ -169,6 +694,76 @@ smd_dma_transfer_fast(const smd_dma_transfer_t *restrict transfer) {
     smd_z80_bus_request_fast();
     *SMD_VDP_CTRL_PORT_U16 = *cmd_p;
     smd_z80_bus_release();
+    smd_sys_ints_restore(sr);
+}
+
+/**
+ * \brief           Try to merge a transfer into the last queued command
+ *
+ * A transfer can be merged when it continues the last queued one in both source
+ * and destination, has the same type, increment and priority, and the resulting
+ * command does not cross a 128kB source boundary nor go over
+ * SMD_DMA_QUEUE_CMD_WORDS_MAX words.
+ *
+ * \param[in]       transfer: Transfer operation configuration
+ * \return          true if the transfer was merged, false otherwise
+ */
+static bool
+smd_dma_queue_coalesce(const smd_dma_transfer_t *restrict transfer) {
+    smd_dma_queue_cmd_t *cmd = smd_dma_queue->tail.cmd;
+    uint32_t src = (uint32_t) transfer->src;
+    uint32_t size;
+
+    if (cmd == nullptr || src != smd_dma_queue->tail.src_end || transfer->dest != smd_dma_queue->tail.dest_end
+        || transfer->type != smd_dma_queue->tail.type || transfer->inc != smd_dma_queue->tail.inc
+        || transfer->priority != smd_dma_queue->tail.priority) {
+        return false;
+    }
+    size = (uint32_t) smd_dma_queue->tail.size + transfer->size;
+    /* The command bytes must fit in 16 bits and the source can't cross 128kB */
+    if (size > SMD_DMA_QUEUE_CMD_WORDS_MAX || ((src + (transfer->size << 1) - 1) >> 17) != smd_dma_queue->tail.src_block) {
+        return false;
+    }
+
+    cmd->length_l = SMD_VDP_REG_DMALEN_L | (size & 0xFF);
+    cmd->length_h = SMD_VDP_REG_DMALEN_H | ((size >> 8) & 0xFF);
+    cmd->bytes += transfer->size << 1;
+    if (transfer->priority == SMD_DMA_PRIORITY_NORMAL) {
+        smd_dma_queue->normal_bytes += transfer->size << 1;
+    }
+    smd_dma_queue->tail.size = size;
+    smd_dma_queue->tail.src_end += transfer->size << 1;
+    smd_dma_queue->tail.dest_end += transfer->size * transfer->inc;
+    ++smd_dma_queue->coalesced;
+    return true;
+}
+
+/**
+ * \brief           Enqueue a tiny transfer as a CPU write with its data inline
+ * \param[in]       transfer: Transfer configuration, size up to SMD_DMA_QUEUE_INLINE_WORDS
+ * \note            The data is copied now, so the source can be released
+ */
+static void
+smd_dma_queue_write_enqueue(const smd_dma_transfer_t *restrict transfer) {
+    smd_dma_queue_cmd_t *cmd;
+    const uint16_t *src = transfer->src;
+
+    cmd = &smd_dma_queue->cmds[smd_dma_queue->index];
+    cmd->autoinc = SMD_VDP_REG_AUTOINC | transfer->inc;
+    for (uint16_t i = 0; i < transfer->size; ++i) {
+        cmd->data[i] = src[i];
+    }
+    /* The write command is the DMA one without the DMA flag */
+    *((uint32_t *) &(cmd->ctrl_addr_h)) = smd_dma_ctrl_addr_build(transfer->type, transfer->dest) & ~0x80;
+    cmd->bytes = transfer->size << 1;
+    cmd->priority = transfer->priority;
+    cmd->op = SMD_DMA_QUEUE_OP_WRITE;
+    cmd->staging = 0;
+    if (transfer->priority == SMD_DMA_PRIORITY_NORMAL) {
+        smd_dma_queue->normal_bytes += cmd->bytes;
+    }
+    smd_dma_queue->tail.cmd = nullptr;
+    ++smd_dma_queue->index;
 }
 
 /**
@@ -177,13 +772,23 @@ smd_dma_transfer_fast(const smd_dma_transfer_t *restrict transfer) {
  * \pre             transfer->inc must be at least 2
  * \note            Parameters or 128kB boundaries are not checked, so be aware
  *                  that it is a bit unsafe if you don't know what you are doing
+ * \note            The transfer is merged with the last queued one when they
+ *                  are contiguous
  */
 void
 smd_dma_transfer_enqueue_fast(const smd_dma_transfer_t *restrict transfer) {
     smd_dma_queue_cmd_t *cmd;
     uint32_t *ctrl_addr_p;
 
-    cmd = &smd_dma_queue[smd_dma_queue_index];
+    if (smd_dma_queue_coalesce(transfer)) {
+        return;
+    }
+    if (transfer->size <= SMD_DMA_CPU_WRITE_THRESHOLD && transfer->size <= SMD_DMA_QUEUE_INLINE_WORDS) {
+        smd_dma_queue_write_enqueue(transfer);
+        return;
+    }
+
+    cmd = &smd_dma_queue->cmds[smd_dma_queue->index];
     ctrl_addr_p = (uint32_t *) &(cmd->ctrl_addr_h);
 
     /* Sets the autoincrement on word writes */
@@ -200,8 +805,27 @@ smd_dma_transfer_enqueue_fast(const smd_dma_transfer_t *restrict transfer) {
     cmd->addr_h = SMD_VDP_REG_DMASRC_H | (((uint32_t) transfer->src >> 17) & 0x7F);
     /* Builds the ctrl port write address command in a ram variable */
     *ctrl_addr_p = smd_dma_ctrl_addr_build(transfer->type, transfer->dest);
+    /* Budget information */
+    cmd->bytes = transfer->size << 1;
+    cmd->priority = transfer->priority;
+    cmd->op = SMD_DMA_QUEUE_OP_TRANSFER;
+    cmd->staging = 0;
+    if (transfer->priority == SMD_DMA_PRIORITY_NORMAL) {
+        smd_dma_queue->normal_bytes += cmd->bytes;
+    }
+    /* Keeps track of this command to extend it with contiguous transfers */
+    smd_dma_queue->tail = (smd_dma_queue_tail_t) {
+        .cmd = cmd,
+        .src_end = (uint32_t) transfer->src + (transfer->size << 1),
+        .src_block = (uint32_t) transfer->src >> 17,
+        .dest_end = transfer->dest + (transfer->size * transfer->inc),
+        .size = transfer->size,
+        .inc = transfer->inc,
+        .priority = transfer->priority,
+        .type = transfer->type
+    };
     /* Advances the queue slot index */
-    ++smd_dma_queue_index;
+    ++smd_dma_queue->index;
 }
 
 void
@@ -210,7 +834,8 @@ smd_dma_transfer_enqueue(const smd_dma_transfer_t *restrict transfer) {
     uint32_t words_to_128k;
     uint16_t transfer_size;
 
-    if (smd_dma_queue_index >= SMD_DMA_QUEUE_SIZE) {
+    smd_kdebug_warning_if(transfer->size > SMD_DMA_QUEUE_CMD_WORDS_MAX, "Transfer too big at smd_dma_transfer_enqueue");
+    if (smd_dma_queue->index >= SMD_DMA_QUEUE_SIZE || transfer->size > SMD_DMA_QUEUE_CMD_WORDS_MAX) {
         return;
     }
 
@@ -229,7 +854,7 @@ smd_dma_transfer_enqueue(const smd_dma_transfer_t *restrict transfer) {
     transfer_size = transfer->size;
     if (transfer_size > words_to_128k) {
         /* There is at least space for one commad, but we need two */
-        if ((smd_dma_queue_index + 1) >= SMD_DMA_QUEUE_SIZE) {
+        if ((smd_dma_queue->index + 1) >= SMD_DMA_QUEUE_SIZE) {
             return;
         }
         /* Pushes a transfer command of second half */
@@ -238,7 +863,8 @@ smd_dma_transfer_enqueue(const smd_dma_transfer_t *restrict transfer) {
             .src = (void *) (((uint32_t) transfer->src) + bytes_to_128k),
             .dest = transfer->dest + bytes_to_128k,
             .size = transfer_size - words_to_128k,
-            .inc = transfer->inc
+            .inc = transfer->inc,
+            .priority = transfer->priority
         });
         transfer_size = words_to_128k;
     }
@@ -248,12 +874,15 @@ smd_dma_transfer_enqueue(const smd_dma_transfer_t *restrict transfer) {
         .src = transfer->src,
         .dest = transfer->dest,
         .size = transfer_size,
-        .inc = transfer->inc
+        .inc = transfer->inc,
+        .priority = transfer->priority
     });
 }
 
 void
 smd_dma_vram_fill(const uint16_t dest, uint16_t size, const uint8_t value, const uint16_t inc) {
+    uint16_t sr;
+
     /*
      * In a DMA fill operation, the first write writes an entire word instead of
      * a byte. Then, in each write a byte is written. Therefore, a size of 1
@@ -269,8 +898,10 @@ smd_dma_vram_fill(const uint16_t dest, uint16_t size, const uint8_t value, const
     /* Prevent VDP corruption waiting for a running DMA copy/fill operation */
     smd_dma_wait();
 
+    /* An interrupt using the VDP would change the DMA registers or the fill address */
+    sr = smd_sys_ints_save();
     /* Sets the autoincrement after each write */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_AUTOINC | inc;
+    smd_vdp_reg_set(SMD_VDP_REG_AUTOINC, inc);
     /* Sets the DMA size in bytes */
     *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMALEN_L | (size & 0xFF);
     *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMALEN_H | ((size >> 8) & 0xFF);
@@ -280,4 +911,281 @@ smd_dma_vram_fill(const uint16_t dest, uint16_t size, const uint8_t value, const
     *SMD_VDP_CTRL_PORT_U32 = smd_dma_ctrl_addr_build(SMD_VDP_DMA_VRAM_WRITE_CMD, dest);
     /* Set fill value. The high byte must be equal for the first write */
     *SMD_VDP_DATA_PORT_U16 = (value << 8) | value;
+    smd_sys_ints_restore(sr);
+}
+
+void
+smd_dma_vram_copy(const uint16_t src, const uint16_t dest, const uint16_t size, const uint16_t inc) {
+    uint16_t sr;
+
+    /* Prevent VDP corruption waiting for a running DMA copy/fill operation */
+    smd_dma_wait();
+
+    /* An interrupt using the VDP would change the DMA registers */
+    sr = smd_sys_ints_save();
+    /* Sets the autoincrement after each byte copied */
+    smd_vdp_reg_set(SMD_VDP_REG_AUTOINC, inc);
+    /* Sets the DMA size in bytes */
+    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMALEN_L | (size & 0xFF);
+    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMALEN_H | ((size >> 8) & 0xFF);
+    /* Sets the DMA source address in VRAM (in bytes, no shift needed) */
+    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMASRC_L | (src & 0xFF);
+    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMASRC_M | (src >> 8);
+    /* Sets the DMA operation to VRAM copy operation */
+    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_DMASRC_H | 0xC0;
+    /* Builds the ctrl port copy address command which starts the copy */
+    *SMD_VDP_CTRL_PORT_U32 = smd_dma_ctrl_addr_build(SMD_VDP_DMA_VRAM_COPY_CMD, dest);
+    smd_sys_ints_restore(sr);
+}
+
+void
+smd_dma_vram_copy_enqueue(const uint16_t src, const uint16_t dest, const uint16_t size, const uint16_t inc,
+                          const smd_dma_priority_t priority) {
+    smd_dma_queue_cmd_t *cmd;
+    uint32_t *ctrl_addr_p;
+
+    /* Copies cost double, see below */
+    smd_kdebug_warning_if(size > SMD_DMA_QUEUE_CMD_WORDS_MAX, "Copy too big at smd_dma_vram_copy_enqueue");
+    if (smd_dma_queue->index >= SMD_DMA_QUEUE_SIZE || size > SMD_DMA_QUEUE_CMD_WORDS_MAX) {
+        return;
+    }
+
+    cmd = &smd_dma_queue->cmds[smd_dma_queue->index];
+    ctrl_addr_p = (uint32_t *) &(cmd->ctrl_addr_h);
+
+    cmd->autoinc = SMD_VDP_REG_AUTOINC | inc;
+    cmd->length_l = SMD_VDP_REG_DMALEN_L | (size & 0xFF);
+    cmd->length_h = SMD_VDP_REG_DMALEN_H | ((size >> 8) & 0xFF);
+    cmd->addr_l = SMD_VDP_REG_DMASRC_L | (src & 0xFF);
+    cmd->addr_m = SMD_VDP_REG_DMASRC_M | (src >> 8);
+    cmd->addr_h = SMD_VDP_REG_DMASRC_H | 0xC0;
+    *ctrl_addr_p = smd_dma_ctrl_addr_build(SMD_VDP_DMA_VRAM_COPY_CMD, dest);
+    /* VRAM copies run at half the speed of a 68k transfer, so they cost double */
+    cmd->bytes = size << 1;
+    cmd->priority = priority;
+    cmd->op = SMD_DMA_QUEUE_OP_COPY;
+    cmd->staging = 0;
+    if (priority == SMD_DMA_PRIORITY_NORMAL) {
+        smd_dma_queue->normal_bytes += cmd->bytes;
+    }
+    /* Transfers can't be merged into a copy command */
+    smd_dma_queue->tail.cmd = nullptr;
+    ++smd_dma_queue->index;
+}
+
+void
+smd_dma_vram_fill_enqueue(const uint16_t dest, uint16_t size, const uint8_t value, const uint16_t inc,
+                          const smd_dma_priority_t priority) {
+    smd_dma_queue_cmd_t *cmd;
+    uint32_t *ctrl_addr_p;
+
+    if (smd_dma_queue->index >= SMD_DMA_QUEUE_SIZE) {
+        return;
+    }
+
+    cmd = &smd_dma_queue->cmds[smd_dma_queue->index];
+    ctrl_addr_p = (uint32_t *) &(cmd->ctrl_addr_h);
+
+    /* Budget uses the real amount of bytes written */
+    cmd->bytes = size;
+    /* The first write is a word, see smd_dma_vram_fill */
+    --size;
+    cmd->autoinc = SMD_VDP_REG_AUTOINC | inc;
+    cmd->length_l = SMD_VDP_REG_DMALEN_L | (size & 0xFF);
+    cmd->length_h = SMD_VDP_REG_DMALEN_H | ((size >> 8) & 0xFF);
+    /* Source address is not used in fills, only its fill operation flag */
+    cmd->addr_l = SMD_VDP_REG_DMASRC_L;
+    cmd->addr_m = SMD_VDP_REG_DMASRC_M;
+    cmd->addr_h = SMD_VDP_REG_DMASRC_H | 0x80;
+    *ctrl_addr_p = smd_dma_ctrl_addr_build(SMD_VDP_DMA_VRAM_WRITE_CMD, dest);
+    /* The fill starts with this data port write. High byte must be equal */
+    cmd->fill_value = (value << 8) | value;
+    cmd->priority = priority;
+    cmd->op = SMD_DMA_QUEUE_OP_FILL;
+    cmd->staging = 0;
+    if (priority == SMD_DMA_PRIORITY_NORMAL) {
+        smd_dma_queue->normal_bytes += cmd->bytes;
+    }
+    /* Transfers can't be merged into a fill command */
+    smd_dma_queue->tail.cmd = nullptr;
+    ++smd_dma_queue->index;
+}
+
+void
+smd_dma_script_run(const smd_dma_queue_cmd_t *restrict script, const uint16_t count) {
+    /* Prevent VDP corruption waiting for a running DMA copy/fill operation */
+    smd_dma_wait();
+
+    smd_z80_bus_request_fast();
+    smd_dma_script_execute(script, count);
+    smd_z80_bus_release();
+}
+
+void
+smd_dma_script_enqueue(const smd_dma_queue_cmd_t *restrict script, const uint16_t count,
+                       const smd_dma_priority_t priority) {
+    smd_dma_queue_cmd_t *cmd;
+    uint32_t bytes = 0;
+
+    if (smd_dma_queue->index >= SMD_DMA_QUEUE_SIZE) {
+        return;
+    }
+    for (uint16_t i = 0; i < count; ++i) {
+        bytes += script[i].bytes;
+    }
+    /* The whole script is a single command for the budget */
+    smd_kdebug_warning_if(bytes > 0xFFFF, "Script too big at smd_dma_script_enqueue");
+    if (bytes > 0xFFFF) {
+        return;
+    }
+
+    cmd = &smd_dma_queue->cmds[smd_dma_queue->index];
+    /* Only a reference to the script is queued, it uses a single slot */
+    *((const smd_dma_queue_cmd_t **) &(cmd->ctrl_addr_h)) = script;
+    cmd->length_l = count;
+    cmd->bytes = bytes;
+    cmd->priority = priority;
+    cmd->op = SMD_DMA_QUEUE_OP_SCRIPT;
+    cmd->staging = 0;
+    if (priority == SMD_DMA_PRIORITY_NORMAL) {
+        smd_dma_queue->normal_bytes += cmd->bytes;
+    }
+    /* Transfers can't be merged into a script command */
+    smd_dma_queue->tail.cmd = nullptr;
+    ++smd_dma_queue->index;
+}
+
+/**
+ * \brief           Reserve bytes from the DMA staging ring
+ * \param[in]       size: Amount of bytes to reserve, multiple of 4
+ * \return          Offset of the reserved bytes in the ring, or -1 if it is full
+ */
+static int32_t
+smd_dma_staging_alloc(const uint16_t size) {
+    uint16_t head = smd_dma_staging_head;
+    uint16_t tail = smd_dma_staging_tail;
+
+    if (head == tail) {
+        /* Empty ring, start again from the beginning to get more room */
+        if (size > SMD_DMA_STAGING_SIZE) {
+            return -1;
+        }
+        smd_dma_staging_tail = 0;
+        return 0;
+    }
+    if (head > tail) {
+        if (size <= SMD_DMA_STAGING_SIZE - head) {
+            return head;
+        }
+        /* Wrap to the beginning, the head must never reach the tail */
+        if (size < tail) {
+            return 0;
+        }
+    } else if (size < tail - head) {
+        return head;
+    }
+    return -1;
+}
+
+void
+smd_dma_transfer_enqueue_staged(const smd_dma_transfer_t *restrict transfer) {
+    smd_dma_queue_cmd_t *cmd;
+    int32_t offset;
+    uint16_t bytes;
+    bool ints_enabled;
+
+    /* Bigger transfers than the ring can never be staged (and their size would wrap) */
+    smd_kdebug_warning_if(transfer->size > SMD_DMA_QUEUE_CMD_WORDS_MAX || transfer->size > (SMD_DMA_STAGING_SIZE >> 1),
+                          "Transfer too big at smd_dma_transfer_enqueue_staged");
+    if (transfer->size > SMD_DMA_QUEUE_CMD_WORDS_MAX || transfer->size > (SMD_DMA_STAGING_SIZE >> 1)) {
+        return;
+    }
+    /* Tiny transfers are copied inline in the queue, they don't need the ring */
+    if (transfer->size <= SMD_DMA_CPU_WRITE_THRESHOLD && transfer->size <= SMD_DMA_QUEUE_INLINE_WORDS) {
+        if (smd_dma_queue->index < SMD_DMA_QUEUE_SIZE) {
+            smd_dma_queue_write_enqueue(transfer);
+        }
+        return;
+    }
+
+    /* Round up to long words for the fast copy */
+    bytes = ((transfer->size << 1) + 3) & (-4);
+
+    /* The vertical blank interrupt can release ring memory when auto flushing */
+    ints_enabled = smd_sys_ints_status();
+    smd_sys_ints_disable();
+
+    offset = (smd_dma_queue->index < SMD_DMA_QUEUE_SIZE) ? smd_dma_staging_alloc(bytes) : -1;
+    smd_kdebug_warning_if(offset < 0, "DMA staging ring overflow at smd_dma_transfer_enqueue_staged");
+    if (offset < 0) {
+        ++smd_dma_staging_overflows;
+    } else {
+        smd_mem_copy_fast(&smd_dma_staging[offset], transfer->src, transfer->size << 1);
+        smd_dma_transfer_enqueue_fast( &(smd_dma_transfer_t) {
+            .type = transfer->type,
+            .src = &smd_dma_staging[offset],
+            .dest = transfer->dest,
+            .size = transfer->size,
+            .inc = transfer->inc,
+            .priority = transfer->priority
+        });
+        /* The command keeps the ring memory until it is executed */
+        cmd = smd_dma_queue->tail.cmd;
+        if (!cmd->staging) {
+            cmd->staging = offset + 1;
+        }
+        smd_dma_staging_head = offset + bytes;
+    }
+
+    if (ints_enabled) {
+        smd_sys_ints_enable();
+    }
+}
+
+uint16_t
+smd_dma_staging_available(void) {
+    uint16_t head = smd_dma_staging_head;
+    uint16_t tail = smd_dma_staging_tail;
+
+    if (head == tail) {
+        return SMD_DMA_STAGING_SIZE;
+    }
+    return (head > tail) ? SMD_DMA_STAGING_SIZE - head + tail : tail - head;
+}
+
+bool
+smd_dma_stream_start(smd_dma_stream_t *restrict stream, const smd_dma_transfer_t *restrict transfer,
+                     const smd_dma_stream_cb_t callback) {
+    for (uint16_t i = 0; i < SMD_DMA_STREAM_MAX; ++i) {
+        if (smd_dma_streams[i] == nullptr) {
+            *stream = (smd_dma_stream_t) {
+                .src = (const uint8_t *) transfer->src,
+                .dest = transfer->dest,
+                .size = transfer->size,
+                .inc = transfer->inc,
+                .done_flush = smd_dma_flush_count,
+                .type = transfer->type,
+                .callback = callback,
+                .done = false
+            };
+            smd_dma_streams[i] = stream;
+            return true;
+        }
+    }
+    smd_kdebug_warning_if(true, "No DMA stream slots available at smd_dma_stream_start");
+    return false;
+}
+
+void
+smd_dma_stream_cancel(smd_dma_stream_t *restrict stream) {
+    for (uint16_t i = 0; i < SMD_DMA_STREAM_MAX; ++i) {
+        if (smd_dma_streams[i] == stream) {
+            smd_dma_streams[i] = nullptr;
+        }
+    }
+}
+
+inline bool
+smd_dma_stream_is_done(const smd_dma_stream_t *restrict stream) {
+    return stream->done;
 }
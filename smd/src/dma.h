@@ -18,7 +18,21 @@
  * A DMA transfer queue is provided to group operations and delay them until the
  * vertical blanking period. When a transfer is queued, no memory copy is
  * performed, only pointers are saved. Therefore, be aware that you must retain
- * memory buffers until the queue flush operation is performed.
+ * memory buffers until the queue flush operation is performed. The exception
+ * are tiny transfers (up to SMD_DMA_CPU_WRITE_THRESHOLD words), whose data is
+ * copied when they are enqueued, so later changes to their source are not
+ * uploaded.
+ * The queue has a per-frame bandwidth budget in bytes based on the current
+ * video mode. Each queued transfer has a priority and the flush operation only
+ * executes what fits in the budget. Remaining commands are kept in order for the
+ * next flush.
+ * Queued transfers contiguous in both source and destination with the last
+ * queued one are merged into it, saving the VDP setup of a new command.
+ * Tiny transfers (see SMD_DMA_CPU_WRITE_THRESHOLD) are written by the CPU, as
+ * setting up the DMA costs more. Queued ones keep the copy of their data inline.
+ * Optionally, the queue can work in auto flush mode. Then it is double buffered:
+ * the game fills a back queue while the vertical blank interrupt executes the
+ * front one, and the game swaps them when its frame is ready.
  *
  * More info:
  * https://www.plutiedev.com/dma-transfer
@@ -42,6 +56,61 @@ extern "C" {
     #define SMD_DMA_QUEUE_SIZE (64)
 #endif
 
+/**
+ * \brief           Default transfer size in words up to which the CPU writes the data port instead of using DMA
+ *
+ * A DMA needs eight control port writes to be set up, so tiny transfers are
+ * faster written by the CPU. Queued writes keep their data inline in the queue
+ * command, so they are limited to SMD_DMA_QUEUE_INLINE_WORDS. Use 0 to always
+ * use DMA.
+ */
+#ifndef SMD_DMA_CPU_WRITE_THRESHOLD
+    #define SMD_DMA_CPU_WRITE_THRESHOLD (4)
+#endif
+
+/**
+ * \brief           Maximum data words a queue command can store inline
+ */
+#define SMD_DMA_QUEUE_INLINE_WORDS (5)
+
+/**
+ * \brief           Default maximum amount of DMA streams running at the same time
+ */
+#ifndef SMD_DMA_STREAM_MAX
+    #define SMD_DMA_STREAM_MAX (4)
+#endif
+
+/**
+ * \brief           Default DMA staging ring size in bytes
+ */
+#ifndef SMD_DMA_STAGING_SIZE
+    #define SMD_DMA_STAGING_SIZE (2048)
+#endif
+
+/**
+ * \brief           DMA bandwidth in bytes per line during the vertical blank
+ */
+#define SMD_DMA_VBLANK_LINE_BYTES_H32 (167)
+#define SMD_DMA_VBLANK_LINE_BYTES_H40 (205)
+
+/**
+ * \brief           Vertical blank length in lines for each video mode
+ */
+#define SMD_DMA_VBLANK_LINES_NTSC_V28 (262 - 224)
+#define SMD_DMA_VBLANK_LINES_PAL_V28  (313 - 224)
+#define SMD_DMA_VBLANK_LINES_PAL_V30  (313 - 240)
+
+/**
+ * \brief           Vertical blank lines not used by the default queue budget
+ *
+ * The queue flush never starts right at the first vertical blank line. These
+ * lines are reserved for the interrupt handler and other immediate transfers
+ * (palettes, sprites) done before the flush.
+ */
+#ifndef SMD_DMA_BUDGET_MARGIN_LINES
+    #define SMD_DMA_BUDGET_MARGIN_LINES (4)
+#endif
+
 /**
  * \brief           DMA transfer types based on VDP's ram destination
  */
@@ -51,6 +120,21 @@ typedef enum smd_dma_transfer_type_t {
     SMD_DMA_VSRAM_TRANSFER = SMD_VDP_DMA_VSRAM_WRITE_CMD    /**< Ram/Rom to VSRam transfer */
 } smd_dma_transfer_type_t;
 
+/**
+ * \brief           DMA queued transfer priorities
+ *
+ * Critical transfers are always executed on the next flush even if the frame
+ * budget is exceeded. Normal transfers are executed while they fit in the
+ * budget and deferrable ones only when all the normal transfers have been done.
+ * \note            Normal priority is 0, so it is the default priority when it
+ *                  is not set in a transfer configuration.
+ */
+typedef enum smd_dma_priority_t {
+    SMD_DMA_PRIORITY_NORMAL     = 0,    /**< Executed if it fits in the frame budget */
+    SMD_DMA_PRIORITY_CRITICAL   = 1,    /**< Always executed in the next flush */
+    SMD_DMA_PRIORITY_DEFERRABLE = 2     /**< Executed after all normal transfers if it fits */
+} smd_dma_priority_t;
+
 /**
  * \brief           DMA transfer operation
  */
@@ -61,8 +145,170 @@ typedef struct smd_dma_transfer_t {
     uint16_t size;                  /**< Transfer size in words */
     uint16_t inc;                   /**< Write position increment after each write (normally 2) */
     smd_dma_transfer_type_t type;   /**< DMA transfer type */
+    smd_dma_priority_t priority;    /**< Queue priority, only used by enqueue operations */
 } smd_dma_transfer_t;
 
+/**
+ * \brief           DMA queue command operations
+ */
+typedef enum smd_dma_queue_op_t {
+    SMD_DMA_QUEUE_OP_TRANSFER = 0,  /**< Ram/Rom to VRam/CRam/VSRam transfer */
+    SMD_DMA_QUEUE_OP_COPY     = 1,  /**< VRam to VRam copy */
+    SMD_DMA_QUEUE_OP_FILL     = 2,  /**< VRam fill */
+    SMD_DMA_QUEUE_OP_SCRIPT   = 3,  /**< Reference to a DMA script (only in the queue) */
+    SMD_DMA_QUEUE_OP_WRITE    = 4   /**< CPU data port write with inline data (only in the queue) */
+} smd_dma_queue_op_t;
+
+/**
+ * \brief           DMA queue command
+ *
+ * Queue commands store the VDP register writes of an operation already encoded,
+ * so they are issued with a few control port writes. They can also be declared
+ * as constant data (DMA scripts) using the SMD_DMA_CMD_* macros.
+ * CPU writes don't use the DMA registers, so they store their data there.
+ */
+typedef struct smd_dma_queue_cmd_t {
+    uint16_t autoinc;           /**< Autoincrement register in bytes */
+    union {
+        struct {
+            uint16_t length_h;  /**< Length register (high) in words */
+            uint16_t length_l;  /**< Length register (low) in words */
+            uint16_t addr_h;    /**< Source address register (high) in words */
+            uint16_t addr_m;    /**< Source address register (middle) in words */
+            uint16_t addr_l;    /**< Source address register (low) in words */
+        };
+        uint16_t data[SMD_DMA_QUEUE_INLINE_WORDS];  /**< Inline data of CPU writes */
+    };
+    uint16_t ctrl_addr_h;       /**< VDP command with the destination address */
+    uint16_t ctrl_addr_l;       /**< VDP command (low). Start transfer */
+    uint16_t bytes;             /**< Transfer size in bytes used by the budget */
+    uint16_t priority;          /**< Queue priority (smd_dma_priority_t) */
+    uint16_t op;                /**< Command operation (smd_dma_queue_op_t) */
+    union {
+        struct {
+            uint16_t fill_value;    /**< Data port write that starts a fill operation */
+            uint16_t staging;       /**< Staging ring offset + 1 of the source, 0 if not staged */
+        };
+        const void *src;            /**< Source of DMA script transfers, set in the registers when issued */
+    };
+} smd_dma_queue_cmd_t;
+
+/**
+ * \brief           Build the control port command words of a DMA operation
+ */
+#define SMD_DMA_CMD_CTRL_H(xram_cmd, dest) ((uint16_t) (((xram_cmd) >> 16) | ((dest) & 0x3FFF)))
+#define SMD_DMA_CMD_CTRL_L(xram_cmd, dest) ((uint16_t) (((xram_cmd) & 0xFFFF) | ((dest) >> 14)))
+
+/**
+ * \brief           Encode a DMA transfer command at compile time
+ * \param[in]       type: DMA transfer type (smd_dma_transfer_type_t)
+ * \param[in]       source: Source address on Ram/Rom space (i.e. a ROM asset)
+ * \param[in]       dest: Destination address on VRam/CRam/VSRam
+ * \param[in]       size: Transfer size in words
+ * \param[in]       inc: Write position increment after each write (normally 2)
+ * \note            C can't split the address of a symbol into register bytes at
+ *                  compile time, so the source pointer is stored in the command
+ *                  and its source registers are set when the script is issued.
+ *                  The source can't cross a 128kB boundary.
+ */
+#define SMD_DMA_CMD_TRANSFER(type, source, dest, size, inc) {               \
+        .autoinc = SMD_VDP_REG_AUTOINC | (inc),                             \
+        .length_h = SMD_VDP_REG_DMALEN_H | (((size) >> 8) & 0xFF),          \
+        .length_l = SMD_VDP_REG_DMALEN_L | ((size) & 0xFF),                 \
+        .addr_h = SMD_VDP_REG_DMASRC_H,                                     \
+        .addr_m = SMD_VDP_REG_DMASRC_M,                                     \
+        .addr_l = SMD_VDP_REG_DMASRC_L,                                     \
+        .ctrl_addr_h = SMD_DMA_CMD_CTRL_H(type, dest),                      \
+        .ctrl_addr_l = SMD_DMA_CMD_CTRL_L(type, dest),                      \
+        .bytes = (size) << 1,                                               \
+        .priority = SMD_DMA_PRIORITY_NORMAL,                                \
+        .op = SMD_DMA_QUEUE_OP_TRANSFER,                                    \
+        .src = (source)                                                     \
+    }
+
+/**
+ * \brief           Encode a DMA VRAM fill command at compile time
+ * \param[in]       dest: Destination address on VRAM
+ * \param[in]       size: Fill size in bytes, minimum 2
+ * \param[in]       value: Byte value used to fill the vram
+ * \param[in]       inc: Write position increment after each write (normally 1)
+ */
+#define SMD_DMA_CMD_FILL(dest, size, value, inc) {                          \
+        .autoinc = SMD_VDP_REG_AUTOINC | (inc),                             \
+        .length_h = SMD_VDP_REG_DMALEN_H | ((((size) - 1) >> 8) & 0xFF),    \
+        .length_l = SMD_VDP_REG_DMALEN_L | (((size) - 1) & 0xFF),           \
+        .addr_h = SMD_VDP_REG_DMASRC_H | 0x80,                              \
+        .addr_m = SMD_VDP_REG_DMASRC_M,                                     \
+        .addr_l = SMD_VDP_REG_DMASRC_L,                                     \
+        .ctrl_addr_h = SMD_DMA_CMD_CTRL_H(SMD_VDP_DMA_VRAM_WRITE_CMD, dest),\
+        .ctrl_addr_l = SMD_DMA_CMD_CTRL_L(SMD_VDP_DMA_VRAM_WRITE_CMD, dest),\
+        .bytes = (size),                                                    \
+        .priority = SMD_DMA_PRIORITY_NORMAL,                                \
+        .op = SMD_DMA_QUEUE_OP_FILL,                                        \
+        .fill_value = (((value) & 0xFF) << 8) | ((value) & 0xFF)            \
+    }
+
+/**
+ * \brief           Encode a DMA VRAM to VRAM copy command at compile time
+ * \param[in]       src: Source address on VRAM
+ * \param[in]       dest: Destination address on VRAM
+ * \param[in]       size: Copy size in bytes
+ * \param[in]       inc: Destination position increment after each byte (normally 1)
+ */
+#define SMD_DMA_CMD_COPY(src, dest, size, inc) {                            \
+        .autoinc = SMD_VDP_REG_AUTOINC | (inc),                             \
+        .length_h = SMD_VDP_REG_DMALEN_H | (((size) >> 8) & 0xFF),          \
+        .length_l = SMD_VDP_REG_DMALEN_L | ((size) & 0xFF),                 \
+        .addr_h = SMD_VDP_REG_DMASRC_H | 0xC0,                              \
+        .addr_m = SMD_VDP_REG_DMASRC_M | (((src) >> 8) & 0xFF),             \
+        .addr_l = SMD_VDP_REG_DMASRC_L | ((src) & 0xFF),                    \
+        .ctrl_addr_h = SMD_DMA_CMD_CTRL_H(SMD_VDP_DMA_VRAM_COPY_CMD, dest), \
+        .ctrl_addr_l = SMD_DMA_CMD_CTRL_L(SMD_VDP_DMA_VRAM_COPY_CMD, dest), \
+        .bytes = (size) << 1,                                               \
+        .priority = SMD_DMA_PRIORITY_NORMAL,                                \
+        .op = SMD_DMA_QUEUE_OP_COPY,                                        \
+        .fill_value = 0                                                     \
+    }
+
+/**
+ * \brief           Amount of commands in a DMA script array
+ */
+#define SMD_DMA_SCRIPT_SIZE(script) (sizeof(script) / sizeof(smd_dma_queue_cmd_t))
+
+/**
+ * \brief           DMA queue statistics of the last flush operation
+ */
+typedef struct smd_dma_stats_t {
+    uint32_t flushed_bytes;         /**< Bytes transferred in the last flush */
+    uint16_t flushed_cmds;          /**< Commands executed in the last flush */
+    uint32_t deferred_bytes;        /**< Bytes carried over to the next flush */
+    uint16_t deferred_cmds;         /**< Commands carried over to the next flush */
+    uint16_t coalesced_cmds;        /**< Transfers merged into other queued commands */
+    uint16_t staging_overflows;     /**< Staged transfers dropped due to a full staging ring */
+    bool vblank_overrun;            /**< Did a non empty flush end after the vertical blank? */
+} smd_dma_stats_t;
+
+/**
+ * \brief           DMA stream object, a big transfer split along several frames
+ */
+typedef struct smd_dma_stream_t smd_dma_stream_t;
+
+/**
+ * \brief           Callback called when a DMA stream has been completely transferred
+ */
+typedef void (*smd_dma_stream_cb_t)(smd_dma_stream_t *stream);
+
+struct smd_dma_stream_t {
+    const uint8_t *src;             /**< Next slice source address on Ram/Rom space */
+    uint16_t dest;                  /**< Next slice destination address */
+    uint16_t size;                  /**< Remaining size to enqueue in words */
+    uint16_t inc;                   /**< Write position increment after each write */
+    uint16_t done_flush;            /**< Queue flush that executes the last slice */
+    smd_dma_transfer_type_t type;   /**< DMA transfer type */
+    smd_dma_stream_cb_t callback;   /**< Completion callback or nullptr */
+    bool done;                      /**< Has the whole stream been transferred? */
+};
+
 /**
  * \brief           Convenient alias for DMA transfer functions
  */
@@ -93,11 +339,105 @@ uint16_t smd_dma_queue_size(void);
 void smd_dma_queue_clear(void);
 
 /**
- * \brief           Execute all the pending DMA's commands in the queue.
- * \note            The queue ends empty
+ * \brief           Execute the pending DMA's commands in the queue that fit in the budget
+ *
+ * Critical commands are always executed. Normal and deferrable commands are
+ * executed in order while they fit in the frame budget, and once a command of
+ * one of these priorities does not fit, the rest of them are deferred. Deferred
+ * commands are kept in the queue in their original order.
+ *
+ * \note            In auto flush mode this executes the back queue immediately,
+ *                  which is useful with the display off.
  */
 void smd_dma_queue_flush(void);
 
+/**
+ * \brief           Make the enqueued DMA's commands ready for the next vertical blank
+ *
+ * In auto flush mode, the back queue (where transfers are enqueued) becomes the
+ * front queue, which is executed at the start of the next vertical blank
+ * interrupt, and a new empty back queue is ready to be filled. If the front
+ * queue still has deferred commands, the back queue is appended to it.
+ *
+ * \note            The swap is atomic, interrupts are disabled meanwhile.
+ */
+void smd_dma_queue_swap(void);
+
+/**
+ * \brief           Execute the front DMA's queue if the auto flush mode is enabled
+ * \note            This function is called at the start of the vertical blank
+ *                  interrupt handler, so you don't need to call it.
+ */
+void smd_dma_queue_vblank_flush(void);
+
+/**
+ * \brief           Enable or disable the DMA's queue auto flush mode
+ *
+ * In auto flush mode the DMA's queue is double buffered and the front queue is
+ * executed from the vertical blank interrupt, so DMA starts on the first
+ * vertical blank line no matter where the main loop is. Use smd_dma_queue_swap
+ * instead of smd_dma_queue_flush to send the enqueued commands.
+ *
+ * \param[in]       enabled: true to enable the auto flush mode, false otherwise
+ * \note            The interrupt handler uses the VDP control port, so immediate
+ *                  DMA operations mask the interrupts while they set up the
+ *                  VDP (see raster.h).
+ */
+void smd_dma_queue_auto_flush_set(const bool enabled);
+
+/**
+ * \brief           Tell if the DMA's queue auto flush mode is enabled
+ * \return          true if the auto flush mode is enabled, false otherwise
+ */
+bool smd_dma_queue_auto_flush_get(void);
+
+/**
+ * \brief           Get the DMA's queue bandwidth budget per flush
+ * \return          Maximum amount of bytes transferred on each queue flush
+ */
+uint16_t smd_dma_budget_get(void);
+
+/**
+ * \brief           Set the DMA's queue bandwidth budget per flush
+ * \param[in]       bytes: Maximum amount of bytes to transfer on each flush
+ */
+void smd_dma_budget_set(const uint16_t bytes);
+
+/**
+ * \brief           Reset the DMA's queue budget to the default one for the current video mode
+ * \note            The default budget is computed from the vertical blank lines
+ *                  of the current display height plus the blanked display lines
+ *                  and the DMA bandwidth of the current H32/H40 mode. This
+ *                  function is called from smd_dma_init, smd_vdp_mode_set and
+ *                  smd_vdp_blank_lines_set.
+ */
+void smd_dma_budget_reset(void);
+
+/**
+ * \brief           Get the DMA's queue statistics of the last flush operation
+ * \return          Last flush statistics
+ */
+const smd_dma_stats_t *smd_dma_stats_get(void);
+
+/**
+ * \brief           Get a sync point for the critical commands enqueued until now
+ *
+ * Use it with smd_dma_queue_sync_done to know when a source buffer of enqueued
+ * critical transfers can be changed again. Normal and deferrable commands can
+ * be deferred by the budget, so they aren't tracked.
+ *
+ * \return          Sync point of the current DMA's queue contents
+ */
+uint16_t smd_dma_queue_sync_get(void);
+
+/**
+ * \brief           Tell if the critical commands enqueued before a sync point were executed
+ * \param[in]       sync: Sync point from smd_dma_queue_sync_get
+ * \return          true once the critical commands enqueued before the sync
+ *                  point have been executed or cleared, false otherwise
+ */
+bool smd_dma_queue_sync_done(const uint16_t sync);
+
 /**
  * \brief           Execute a DMA transfer from RAM/ROM to VRam/CRam/VSRam
  * \param[in]       transfer: Transfer operation configuration
@@ -111,16 +451,53 @@ void smd_dma_transfer(const smd_dma_transfer_t *restrict transfer);
  * \pre             transfer->inc must be at least 2
  * \note            Parameters or 128kB boundaries are not checked, so be aware
  *                  that it is a bit unsafe if you don't know what you are doing
+ * \note            Transfers up to SMD_DMA_CPU_WRITE_THRESHOLD words aren't DMA,
+ *                  the CPU writes them through the data port. Interrupts are
+ *                  masked during the writes, as a handler using the VDP control
+ *                  port would change the write address, so the vertical blank
+ *                  and raster interrupts can be delayed by them.
  */
 void smd_dma_transfer_fast(const smd_dma_transfer_t *restrict transfer);
 
 /**
  * \brief           Enqueue a new DMA transfer from RAM/ROM to VRam/CRam/VSRam
- * \param[in]       transfer: Transfer operation configuration
+ * \param[in]       transfer: Transfer operation configuration. Its priority
+ *                  field sets how the transfer is handled by the flush budget
  * \pre             transfer->inc must be at least 2
+ * \note            If the transfer continues the last queued one (same type,
+ *                  increment and priority, contiguous source and destination
+ *                  and no 128kB source boundary crossed) both are merged in a
+ *                  single command.
+ * \note            Transfers over 0x7FFF words (the whole VRAM) are rejected.
+ * \note            Transfers up to SMD_DMA_CPU_WRITE_THRESHOLD words copy their
+ *                  source data into the queue now, the other ones read it when
+ *                  the queue is flushed.
  */
 void smd_dma_transfer_enqueue(const smd_dma_transfer_t *restrict transfer);
 
+/**
+ * \brief           Enqueue a new DMA transfer copying its source to the staging ring
+ *
+ * The source data is copied into a DMA staging ring in work RAM and the
+ * transfer is queued from there, so the source buffer can be released right
+ * after this call (stack buffers, temporary arena memory, etc.). The staging
+ * memory is released once the transfer has been flushed.
+ *
+ * \param[in]       transfer: Transfer operation configuration
+ * \pre             transfer->inc must be at least 2
+ * \note            If the transfer doesn't fit in the staging ring it is
+ *                  dropped and counted in the staging_overflows statistic.
+ *                  Transfers bigger than SMD_DMA_STAGING_SIZE are rejected.
+ */
+void smd_dma_transfer_enqueue_staged(const smd_dma_transfer_t *restrict transfer);
+
+/**
+ * \brief           Get the free bytes in the DMA staging ring
+ * \return          Current amount of free bytes in the staging ring
+ * \note            The free space may not be contiguous
+ */
+uint16_t smd_dma_staging_available(void);
+
 /**
  * \brief           Executes a DMA VRAM fill operation
  * \param[in]       dest: Destination address on VRAM
@@ -136,6 +513,116 @@ void smd_dma_transfer_enqueue(const smd_dma_transfer_t *restrict transfer);
  */
 void smd_dma_vram_fill(const uint16_t dest, uint16_t size, const uint8_t value, const uint16_t inc);
 
+/**
+ * \brief           Enqueue a new DMA VRAM fill operation
+ * \param[in]       dest: Destination address on VRAM
+ * \param[in]       size: Fill size in bytes, minimum 2
+ * \param[in]       value: Value used to fill the vram
+ * \param[in]       inc: Write position increment after each write (normally 1)
+ * \param[in]       priority: Queue priority of the fill
+ * \pre             size must be at least 2 (see smd_dma_vram_fill)
+ * \note            The queue flush waits for the fill to end before executing
+ *                  the next command.
+ */
+void smd_dma_vram_fill_enqueue(const uint16_t dest, uint16_t size, const uint8_t value, const uint16_t inc,
+                               const smd_dma_priority_t priority);
+
+/**
+ * \brief           Executes a DMA VRAM to VRAM copy operation
+ *
+ * The VDP copies the data inside VRAM without using the m68k bus. The copy is
+ * byte oriented: the source address always advances one byte after each copied
+ * byte, while the destination address advances by the autoincrement value. So,
+ * an increment of 1 copies a block as is, and an increment of 2 spreads the
+ * source bytes over the even (or odd) bytes of the destination.
+ *
+ * \param[in]       src: Source address on VRAM
+ * \param[in]       dest: Destination address on VRAM
+ * \param[in]       size: Copy size in bytes
+ * \param[in]       inc: Destination position increment after each byte (normally 1)
+ * \note            The DMA VRAM copy operation does not stop the m68k, so it is
+ *                  a good idea to use it with smd_dma_wait() function to wait for
+ *                  it to finish the copy operation.
+ * \note            A VRAM copy is about half as fast as a transfer from RAM/ROM.
+ */
+void smd_dma_vram_copy(const uint16_t src, const uint16_t dest, const uint16_t size, const uint16_t inc);
+
+/**
+ * \brief           Enqueue a new DMA VRAM to VRAM copy operation
+ * \param[in]       src: Source address on VRAM
+ * \param[in]       dest: Destination address on VRAM
+ * \param[in]       size: Copy size in bytes
+ * \param[in]       inc: Destination position increment after each byte (normally 1)
+ * \param[in]       priority: Queue priority of the copy
+ * \note            See smd_dma_vram_copy for the increment behaviour. The copy
+ *                  uses twice its size from the frame budget as it is half as
+ *                  fast as a transfer. The queue flush waits for the copy to end
+ *                  before executing the next command. Copies over 0x7FFF bytes
+ *                  are rejected, split them in two.
+ */
+void smd_dma_vram_copy_enqueue(const uint16_t src, const uint16_t dest, const uint16_t size, const uint16_t inc,
+                               const smd_dma_priority_t priority);
+
+/**
+ * \brief           Start a DMA stream, a transfer split in slices along several frames
+ *
+ * Big transfers (a whole tileset for example) can't be done in a vertical blank.
+ * A stream feeds the DMA queue with slices that fit the budget left on each
+ * queue flush (or swap in auto flush mode) until the whole transfer is done.
+ * Slices are enqueued as critical transfers sized to the remaining budget, so
+ * they are always executed on the flush they are fed to.
+ *
+ * \param[out]      stream: Stream object to setup. It must stay alive until done
+ * \param[in]       transfer: Whole transfer configuration (priority is ignored)
+ * \param[in]       callback: Function called when the stream is done or nullptr
+ * \return          true on success, false if there are too many running streams
+ * \note            The source buffer must stay alive until the stream is done.
+ *                  Slices use smd_dma_transfer_enqueue, so 128kB boundaries are
+ *                  handled.
+ */
+bool smd_dma_stream_start(smd_dma_stream_t *restrict stream, const smd_dma_transfer_t *restrict transfer,
+                          const smd_dma_stream_cb_t callback);
+
+/**
+ * \brief           Stop a running DMA stream
+ * \param[in]       stream: Stream to stop
+ * \note            Slices already enqueued are still transferred
+ */
+void smd_dma_stream_cancel(smd_dma_stream_t *restrict stream);
+
+/**
+ * \brief           Tell if a DMA stream has been completely transferred
+ * \param[in]       stream: Stream to check
+ * \return          true if the whole stream has been transferred, false otherwise
+ */
+bool smd_dma_stream_is_done(const smd_dma_stream_t *restrict stream);
+
+/**
+ * \brief           Execute a DMA script immediately
+ *
+ * A DMA script is a constant array of DMA commands encoded at compile time (see
+ * SMD_DMA_CMD_TRANSFER, SMD_DMA_CMD_FILL and SMD_DMA_CMD_COPY) which can be
+ * executed directly from ROM without any encoding cost.
+ *
+ * \param[in]       script: DMA commands to execute
+ * \param[in]       count: Amount of commands in the script
+ * \note            The frame budget is not checked
+ */
+void smd_dma_script_run(const smd_dma_queue_cmd_t *restrict script, const uint16_t count);
+
+/**
+ * \brief           Enqueue a DMA script in the DMA queue
+ * \param[in]       script: DMA commands to execute. They must stay alive until
+ *                  the queue is flushed
+ * \param[in]       count: Amount of commands in the script
+ * \param[in]       priority: Queue priority of the whole script
+ * \note            Only a reference to the script is queued, so the whole
+ *                  script uses a single queue slot and is executed at once.
+ *                  Scripts over 0xFFFF bytes are rejected.
+ */
+void smd_dma_script_enqueue(const smd_dma_queue_cmd_t *restrict script, const uint16_t count,
+                            const smd_dma_priority_t priority);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,10 @@
  */
 
 #include "handlers.h"
+#include "dma.h"
+#include "perf.h"
+#include "raster.h"
+#include "sprite.h"
 #include "xgm.h"
 #include "vdp.h"
 
@@ -53,14 +57,30 @@ void smd_int_external(void)
 
 [[gnu::interrupt]]
 void smd_int_hblank(void)
-{}
+{
+    smd_raster_hint_update();
+    /* Bottom blanked lines are part of the vertical blank DMA window */
+    if (smd_vdp_blank_hint_update()) {
+        /* Keep the vblank interrupt out until the queue is flushed (rte restores sr) */
+        __asm__ volatile("\tori.w	#0x700, %sr\n");
+        smd_dma_queue_vblank_flush();
+    }
+}
 
 [[gnu::interrupt]]
 void smd_int_vblank(void)
 {
+    /* Deferred registers and DMA queue go first to use the whole vertical blank */
+    smd_vdp_reg_flush();
+    smd_vdp_field_update();
+    smd_raster_vint_update();
+    if (smd_vdp_blank_vint_update()) {
+        smd_dma_queue_vblank_flush();
+    }
     smd_xgm_update();
     smd_vdp_vblank_flag = 1;
     ++smd_int_counter;
+    smd_perf_vblank_update();
 }
 
 [[gnu::interrupt]]
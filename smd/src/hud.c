@@ -0,0 +1,225 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            hud.c
+ * \brief           Head-up display on the window plane
+ */
+
+#include "hud.h"
+#include "dma.h"
+#include "kdebug.h"
+#include "vdp.h"
+
+/**
+ * \brief           Maximum HUD rows (V30 mode)
+ */
+#define SMD_HUD_ROWS_MAX        (30)
+
+/**
+ * \brief           HUD cells ram copy, rows are stored using the region width
+ */
+static smd_plane_cell smd_hud_cells[SMD_HUD_CELLS_MAX];
+
+/**
+ * \brief           Dirty range of cells for each HUD row
+ * \note            The range is empty when first is greater than last
+ */
+static uint8_t smd_hud_dirty_first[SMD_HUD_ROWS_MAX];
+static uint8_t smd_hud_dirty_last[SMD_HUD_ROWS_MAX];
+
+/**
+ * \brief           Current HUD region
+ */
+static smd_hud_region_t smd_hud_region;
+
+/**
+ * \brief           HUD region position in the screen and size in cells
+ */
+static uint16_t smd_hud_x;
+static uint16_t smd_hud_y;
+static uint16_t smd_hud_width;
+static uint16_t smd_hud_height;
+
+/**
+ * \brief           Add a range of cells to a HUD row dirty range
+ * \param[in]       y: Changed row
+ * \param[in]       first: First changed cell
+ * \param[in]       last: Last changed cell
+ */
+static inline void
+smd_hud_dirty_add(const uint16_t y, const uint16_t first, const uint16_t last) {
+    if (first < smd_hud_dirty_first[y]) {
+        smd_hud_dirty_first[y] = first;
+    }
+    if (last > smd_hud_dirty_last[y]) {
+        smd_hud_dirty_last[y] = last;
+    }
+}
+
+void
+smd_hud_init(void) {
+    smd_hud_region = SMD_HUD_REGION_NONE;
+    smd_hud_x = 0;
+    smd_hud_y = 0;
+    smd_hud_width = 0;
+    smd_hud_height = 0;
+    for (uint16_t i = 0; i < SMD_HUD_ROWS_MAX; ++i) {
+        smd_hud_dirty_first[i] = 0xFF;
+        smd_hud_dirty_last[i] = 0;
+    }
+}
+
+bool
+smd_hud_region_set(const smd_hud_region_t region, const uint8_t size) {
+    const uint16_t screen_width = smd_vdp_screen_width_get() >> 3;
+    const uint16_t screen_height = smd_vdp_screen_height_get() >> 3;
+    /* Columns are placed by the VDP in pairs */
+    const uint16_t columns = (size + 1) & ~1;
+    uint8_t xpos = 0;
+    uint8_t ypos = 0;
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+
+    switch (region) {
+    case SMD_HUD_REGION_TOP:
+        ypos = size;
+        width = screen_width;
+        height = size;
+        break;
+    case SMD_HUD_REGION_BOTTOM:
+        ypos = 0x80 | (screen_height - size);
+        y = screen_height - size;
+        width = screen_width;
+        height = size;
+        break;
+    case SMD_HUD_REGION_LEFT:
+        xpos = columns >> 1;
+        width = columns;
+        height = screen_height;
+        break;
+    case SMD_HUD_REGION_RIGHT:
+        xpos = 0x80 | ((screen_width - columns) >> 1);
+        x = screen_width - columns;
+        width = columns;
+        height = screen_height;
+        break;
+    default:
+        break;
+    }
+
+    /* Layouts sharing the window with plane A (see vdp.h) would draw the HUD over plane A */
+    if (region != SMD_HUD_REGION_NONE && SMD_VDP_PLANE_W_ADDR == SMD_VDP_PLANE_A_ADDR) {
+        smd_kdebug_warning_if(true, "Window plane shares plane A at smd_hud_region_set");
+        return false;
+    }
+    if (width * height > SMD_HUD_CELLS_MAX || width > screen_width || height > screen_height) {
+        smd_kdebug_warning_if(true, "HUD region too big at smd_hud_region_set");
+        return false;
+    }
+
+    /* Old region dirty ranges are meaningless now */
+    smd_hud_init();
+    smd_hud_region = region;
+    smd_hud_x = x;
+    smd_hud_y = y;
+    smd_hud_width = width;
+    smd_hud_height = height;
+    /* Applied in the next vertical blank to avoid tearing */
+    smd_vdp_reg_defer(SMD_VDP_REG_WINDOW_XPOS, xpos);
+    smd_vdp_reg_defer(SMD_VDP_REG_WINDOW_YPOS, ypos);
+    smd_hud_clear();
+    return true;
+}
+
+inline smd_hud_region_t
+smd_hud_region_get(void) {
+    return smd_hud_region;
+}
+
+inline uint16_t
+smd_hud_width_get(void) {
+    return smd_hud_width;
+}
+
+inline uint16_t
+smd_hud_height_get(void) {
+    return smd_hud_height;
+}
+
+inline void
+smd_hud_cell_set(const uint16_t x, const uint16_t y, const smd_plane_cell cell) {
+    smd_hud_cells[y * smd_hud_width + x] = cell;
+    smd_hud_dirty_add(y, x, x);
+}
+
+void
+smd_hud_row_set(const uint16_t x, const uint16_t y, const smd_plane_cell *restrict cells,
+                const uint16_t count) {
+    smd_plane_cell *dest = &smd_hud_cells[y * smd_hud_width + x];
+
+    if (count == 0) {
+        return;
+    }
+    for (uint16_t i = 0; i < count; ++i) {
+        dest[i] = cells[i];
+    }
+    smd_hud_dirty_add(y, x, x + count - 1);
+}
+
+void
+smd_hud_rect_fill(const uint16_t x, const uint16_t y, const uint16_t width, const uint16_t height,
+                  const smd_plane_cell cell) {
+    smd_plane_cell *dest;
+
+    if (width == 0) {
+        return;
+    }
+    for (uint16_t row = y; row < y + height; ++row) {
+        dest = &smd_hud_cells[row * smd_hud_width + x];
+        for (uint16_t i = 0; i < width; ++i) {
+            dest[i] = cell;
+        }
+        smd_hud_dirty_add(row, x, x + width - 1);
+    }
+}
+
+inline void
+smd_hud_clear(void) {
+    smd_hud_rect_fill(0, 0, smd_hud_width, smd_hud_height, 0x0000);
+}
+
+void
+smd_hud_update(void) {
+    const uint16_t shift = smd_vdp_window_width_shift_get();
+    uint16_t first;
+    uint16_t last;
+
+    for (uint16_t y = 0; y < smd_hud_height; ++y) {
+        first = smd_hud_dirty_first[y];
+        last = smd_hud_dirty_last[y];
+        if (first <= last) {
+            /* A full queue would drop the transfer, the rows are kept for the next update */
+            if (smd_dma_queue_size() >= SMD_DMA_QUEUE_SIZE) {
+                return;
+            }
+            smd_dma_transfer_enqueue( &(smd_dma_transfer_t) {
+                .type = SMD_DMA_VRAM_TRANSFER,
+                .src = &smd_hud_cells[y * smd_hud_width + first],
+                .dest = SMD_PLANE_W + ((((smd_hud_y + y) << shift) + smd_hud_x + first) << 1),
+                .size = last - first + 1,
+                .inc = 2,
+                .priority = SMD_DMA_PRIORITY_NORMAL
+            });
+            smd_hud_dirty_first[y] = 0xFF;
+            smd_hud_dirty_last[y] = 0;
+        }
+    }
+}
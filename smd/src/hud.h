@@ -0,0 +1,145 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            hud.h
+ * \brief           Head-up display on the window plane
+ *
+ * The window plane replaces plane A on a fixed region of the screen that is not
+ * affected by scrolling, which is perfect for a HUD. The region can be some rows
+ * at the top or bottom of the screen, or some columns at its left or right side.
+ * The HUD keeps a ram copy of its cells. Changed cells are tracked as a dirty
+ * range per row and only those ranges are uploaded through the DMA queue by
+ * smd_hud_update.
+ * HUD coordinates are relative to the region, (0, 0) is its top left cell.
+ * The window name table uses the #D000..#DFFF VRAM room of the default layout
+ * (see vdp.h), so those tiles can't be used while a HUD region is set.
+ */
+
+#ifndef SMD_HUD_H
+#define SMD_HUD_H
+
+#include <stdint.h>
+#include "plane.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief           Default maximum amount of cells in the HUD region
+ */
+#ifndef SMD_HUD_CELLS_MAX
+    #define SMD_HUD_CELLS_MAX (320)
+#endif
+
+/**
+ * \brief           Screen sides where the HUD region can be placed
+ */
+typedef enum smd_hud_region_t {
+    SMD_HUD_REGION_NONE   = 0,  /**< No HUD, the window plane is not shown */
+    SMD_HUD_REGION_TOP    = 1,  /**< Rows at the top of the screen */
+    SMD_HUD_REGION_BOTTOM = 2,  /**< Rows at the bottom of the screen */
+    SMD_HUD_REGION_LEFT   = 3,  /**< Columns at the left side of the screen */
+    SMD_HUD_REGION_RIGHT  = 4   /**< Columns at the right side of the screen */
+} smd_hud_region_t;
+
+/**
+ * \brief           Initialise the HUD system
+ * \note            This function is called from the boot process so maybe you
+ *                  don't need to call it anymore.
+ */
+void smd_hud_init(void);
+
+/**
+ * \brief           Set the screen region covered by the HUD
+ * \param[in]       region: Screen side where the HUD is placed
+ * \param[in]       size: Rows (top, bottom) or columns (left, right) covered.
+ *                  The VDP places columns in pairs, so odd sizes are rounded up
+ * \return          true on success, false if the region has too many cells or
+ *                  the VRAM layout shares the window with plane A (the
+ *                  SMD_HUD_REGION_NONE region is always allowed)
+ * \note            The window registers are changed in the next vertical blank.
+ *                  The HUD cells are cleared.
+ * \note            The region cells are written over the window name table, so
+ *                  tiles loaded there (#D000 in the default layout) are lost.
+ */
+bool smd_hud_region_set(const smd_hud_region_t region, const uint8_t size);
+
+/**
+ * \brief           Get the current HUD region
+ * \return          Screen side where the HUD is placed, SMD_HUD_REGION_NONE if
+ *                  the HUD is not shown
+ */
+smd_hud_region_t smd_hud_region_get(void);
+
+/**
+ * \brief           Get the HUD region width in cells
+ * \return          Region width
+ */
+uint16_t smd_hud_width_get(void);
+
+/**
+ * \brief           Get the HUD region height in cells
+ * \return          Region height
+ */
+uint16_t smd_hud_height_get(void);
+
+/**
+ * \brief           Set a HUD cell
+ * \param[in]       x: Horizontal position in the HUD region
+ * \param[in]       y: Vertical position in the HUD region
+ * \param[in]       cell: Cell value
+ * \note            No boundary checks are done, keep the position inside the region
+ */
+void smd_hud_cell_set(const uint16_t x, const uint16_t y, const smd_plane_cell cell);
+
+/**
+ * \brief           Set a row of HUD cells
+ * \param[in]       x: Horizontal position in the HUD region
+ * \param[in]       y: Vertical position in the HUD region
+ * \param[in]       cells: Cells to set
+ * \param[in]       count: Amount of cells to set
+ * \note            No boundary checks are done, keep the row inside the region
+ */
+void smd_hud_row_set(const uint16_t x, const uint16_t y, const smd_plane_cell *restrict cells,
+                     const uint16_t count);
+
+/**
+ * \brief           Fill a rectangle of HUD cells with the same cell
+ * \param[in]       x: Horizontal position in the HUD region
+ * \param[in]       y: Vertical position in the HUD region
+ * \param[in]       width: Rectangle width in cells
+ * \param[in]       height: Rectangle height in cells
+ * \param[in]       cell: Cell value
+ * \note            No boundary checks are done, keep the rectangle inside the region
+ */
+void smd_hud_rect_fill(const uint16_t x, const uint16_t y, const uint16_t width, const uint16_t height,
+                       const smd_plane_cell cell);
+
+/**
+ * \brief           Clear all the HUD cells
+ */
+void smd_hud_clear(void);
+
+/**
+ * \brief           Enqueue the changed HUD cells in the DMA queue
+ * \note            Small ranges (see SMD_DMA_CPU_WRITE_THRESHOLD) are copied
+ *                  into the queue, so the ram copy must be considered captured
+ *                  when this function runs. Later changes are uploaded by the
+ *                  next call.
+ * \note            Rows that don't fit in a full DMA queue keep their dirty
+ *                  state for the next call.
+ */
+void smd_hud_update(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMD_HUD_H */
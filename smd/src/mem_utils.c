@@ -36,3 +36,20 @@ smd_mem_copy(void *dest, const void *src, uint16_t size) {
         --size;
     }
 }
+
+void
+smd_mem_copy_fast(void *dest, const void *src, uint16_t size) {
+    uint32_t *d = (uint32_t *) dest;
+    const uint32_t *s = (const uint32_t *) src;
+
+    /* The m68k can do long word accesses on even addresses */
+    for (uint16_t i = size >> 2; i; --i) {
+        *d = *s;
+        ++d;
+        ++s;
+    }
+    /* Remaining word */
+    if (size & 0x02) {
+        *((uint16_t *) d) = *((const uint16_t *) s);
+    }
+}
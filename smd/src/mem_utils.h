@@ -36,6 +36,15 @@ void smd_mem_set(void *dest, const uint8_t value, uint16_t size);
  */
 void smd_mem_copy(void *dest, const void *src, uint16_t size);
 
+/**
+ * \brief           Copy a memory area from src to dest using long word copies
+ * \param[in]       dest: Destination memory address
+ * \param[in]       src: Source data
+ * \param[in]       size: Amount of bytes to copy, multiple of 2
+ * \pre             dest and src must be word aligned (even addresses)
+ */
+void smd_mem_copy_fast(void *dest, const void *src, uint16_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,156 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            perf.c
+ * \brief           CPU load meter and vertical blank overrun detection
+ */
+
+#include "perf.h"
+#include "hud.h"
+#include "mem_map.h"
+#include "vdp.h"
+
+/**
+ * \brief           Busy lines of the last frames, used as a ring
+ */
+static uint8_t smd_perf_window[SMD_PERF_WINDOW];
+static uint16_t smd_perf_window_index;
+
+/**
+ * \brief           Vertical blank interrupts counter, never reset by the game
+ */
+static volatile uint8_t smd_perf_vblank_counter;
+
+/**
+ * \brief           Vertical blank interrupts counter when the frame started
+ */
+static uint8_t smd_perf_int_counter;
+
+/**
+ * \brief           CPU load statistics
+ */
+static smd_perf_stats_t smd_perf_stats;
+
+/**
+ * \brief           Get the active display lines drawn at a frame end
+ * \param[in]       line: V counter value
+ * \param[in]       status: VDP status register value
+ * \return          Busy lines, 0 if the frame ended inside the vertical blank
+ */
+static inline uint16_t
+smd_perf_busy_lines(const uint8_t line, const uint16_t status) {
+    /* Status register bit 3 is set on the vertical blank and while the display is off */
+    if (!(status & 0x08)) {
+        return line + 1;
+    }
+    if (line >= smd_vdp_screen_height_get()) {
+        return 0;
+    }
+    /* Blanked display lines or the PAL V counter wrapping inside the vertical blank */
+    if (smd_vdp_blank_lines_get() != 0 || !(smd_vdp_reg_get(SMD_VDP_REG_MODESET_2) & 0x40)) {
+        return line + 1;
+    }
+    return 0;
+}
+
+void
+smd_perf_init(void) {
+    smd_perf_reset();
+}
+
+void
+smd_perf_reset(void) {
+    for (uint16_t i = 0; i < SMD_PERF_WINDOW; ++i) {
+        smd_perf_window[i] = 0;
+    }
+    smd_perf_window_index = 0;
+    smd_perf_stats = (smd_perf_stats_t) {0};
+    smd_perf_int_counter = smd_perf_vblank_counter;
+}
+
+void
+smd_perf_frame_end(void) {
+    const uint8_t line = *SMD_VDP_HV_COUNTER_PORT >> 8;
+    const uint16_t status = *SMD_VDP_CTRL_PORT_U16;
+    const uint16_t height = smd_vdp_screen_height_get();
+    const uint8_t lags = smd_perf_vblank_counter - smd_perf_int_counter;
+    uint16_t busy;
+    uint16_t bucket;
+
+    /* The vertical blank came before the wait, the next one is waited */
+    if (lags) {
+        smd_perf_stats.lag_frames += lags;
+        busy = height;
+    } else {
+        busy = smd_perf_busy_lines(line, status);
+    }
+
+    smd_perf_window[smd_perf_window_index] = busy;
+    smd_perf_window_index = (smd_perf_window_index + 1) & (SMD_PERF_WINDOW - 1);
+    bucket = (busy * SMD_PERF_HISTOGRAM_BUCKETS) / height;
+    if (bucket >= SMD_PERF_HISTOGRAM_BUCKETS) {
+        bucket = SMD_PERF_HISTOGRAM_BUCKETS - 1;
+    }
+    ++smd_perf_stats.histogram[bucket];
+    ++smd_perf_stats.frames;
+    smd_perf_stats.load_last = busy;
+    smd_perf_stats.line_end = line;
+}
+
+void
+smd_perf_frame_start(const uint16_t idle) {
+    smd_perf_stats.line_start = *SMD_VDP_HV_COUNTER_PORT >> 8;
+    smd_perf_stats.idle_last = idle;
+    smd_perf_int_counter = smd_perf_vblank_counter;
+}
+
+inline void
+smd_perf_vblank_update(void) {
+    ++smd_perf_vblank_counter;
+}
+
+inline void
+smd_perf_dma_overrun_add(void) {
+    ++smd_perf_stats.dma_overruns;
+}
+
+const smd_perf_stats_t *
+smd_perf_stats_get(void) {
+    uint16_t sum = 0;
+    uint16_t worst = 0;
+
+    for (uint16_t i = 0; i < SMD_PERF_WINDOW; ++i) {
+        sum += smd_perf_window[i];
+        if (smd_perf_window[i] > worst) {
+            worst = smd_perf_window[i];
+        }
+    }
+    /* Frames not measured yet count as idle ones */
+    smd_perf_stats.load_avg = sum / SMD_PERF_WINDOW;
+    smd_perf_stats.load_worst = worst;
+    return &smd_perf_stats;
+}
+
+void
+smd_perf_bar_draw(const uint16_t x, const uint16_t y, const uint16_t width,
+                  const smd_plane_cell cell) {
+    const smd_perf_stats_t *stats = smd_perf_stats_get();
+    uint16_t filled;
+
+    /* Without a region the HUD cells aren't shown */
+    if (smd_hud_region_get() == SMD_HUD_REGION_NONE) {
+        return;
+    }
+    filled = (stats->load_avg * width) / smd_vdp_screen_height_get();
+    if (filled > width) {
+        filled = width;
+    }
+    smd_hud_rect_fill(x, y, filled, 1, cell);
+    smd_hud_rect_fill(x + filled, y, width - filled, 1, 0x0000);
+}
@@ -0,0 +1,129 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            perf.h
+ * \brief           CPU load meter and vertical blank overrun detection
+ *
+ * A frame starts when smd_vdp_vsync_wait returns and ends when the main loop
+ * calls it again. The VDP HV counter is sampled on both points and the frame
+ * load is measured as the active display lines already drawn when the main
+ * loop finished its work (0 if it finished inside the vertical blank).
+ * A lag frame happens when the vertical blank interrupt fires before the main
+ * loop waits for it, so the game misses a whole frame. DMA queue flushes that
+ * end after the vertical blank are also counted, as they write VRAM while the
+ * display is drawn.
+ * The load of the last SMD_PERF_WINDOW frames is kept to get rolling average
+ * and worst values. A histogram of the frames load since the last reset is
+ * also kept.
+ * \note            Line measures are approximate in PAL and interlace modes,
+ *                  where the VDP V counter isn't linear.
+ */
+
+#ifndef SMD_PERF_H
+#define SMD_PERF_H
+
+#include <stdint.h>
+#include "plane.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief           Default amount of frames used by the rolling statistics
+ * \note            It must be a power of 2
+ */
+#ifndef SMD_PERF_WINDOW
+    #define SMD_PERF_WINDOW (32)
+#endif
+
+/**
+ * \brief           Load histogram buckets, each one covers 1/8 of the active display
+ */
+#define SMD_PERF_HISTOGRAM_BUCKETS (8)
+
+/**
+ * \brief           CPU load statistics
+ */
+typedef struct smd_perf_stats_t {
+    uint16_t load_last;         /**< Busy lines in the last frame */
+    uint16_t load_avg;          /**< Average busy lines in the window frames */
+    uint16_t load_worst;        /**< Worst busy lines in the window frames */
+    uint16_t idle_last;         /**< Idle iterations of the last vsync wait */
+    uint8_t line_start;         /**< V counter when the last frame started */
+    uint8_t line_end;           /**< V counter when the last frame ended */
+    uint32_t frames;            /**< Frames measured since the last reset */
+    uint32_t lag_frames;        /**< Vertical blanks missed since the last reset */
+    uint32_t dma_overruns;      /**< DMA flushes ended after the vertical blank since the last reset */
+    uint32_t histogram[SMD_PERF_HISTOGRAM_BUCKETS]; /**< Frames per load bucket, lag frames go to the last one */
+} smd_perf_stats_t;
+
+/**
+ * \brief           Initialise the CPU load meter
+ * \note            This function is called from the boot process so maybe you
+ *                  don't need to call it anymore.
+ */
+void smd_perf_init(void);
+
+/**
+ * \brief           Reset the statistics
+ * \note            Call it after loading screens or other long tasks so they
+ *                  aren't counted as lag frames.
+ */
+void smd_perf_reset(void);
+
+/**
+ * \brief           End the current frame measure
+ * \note            Called from smd_vdp_vsync_wait before waiting
+ */
+void smd_perf_frame_end(void);
+
+/**
+ * \brief           Start a new frame measure
+ * \param[in]       idle: Idle iterations done waiting the vertical blank
+ * \note            Called from smd_vdp_vsync_wait after waiting
+ */
+void smd_perf_frame_start(const uint16_t idle);
+
+/**
+ * \brief           Count a vertical blank interrupt
+ * \note            Called from the vertical blank interrupt handler. The
+ *                  smd_int_counter isn't used as the game resets it.
+ */
+void smd_perf_vblank_update(void);
+
+/**
+ * \brief           Count a DMA queue flush ended after the vertical blank
+ * \note            Called from the DMA queue flush
+ */
+void smd_perf_dma_overrun_add(void);
+
+/**
+ * \brief           Get the CPU load statistics
+ * \return          Statistics with the rolling values updated
+ */
+const smd_perf_stats_t *smd_perf_stats_get(void);
+
+/**
+ * \brief           Draw the average CPU load as a bar on the HUD
+ * \param[in]       x: Horizontal position in the HUD region
+ * \param[in]       y: Vertical position in the HUD region
+ * \param[in]       width: Bar width in cells, a full bar is the whole active display
+ * \param[in]       cell: Cell used for the filled part of the bar, the rest is cleared
+ * \note            The bar must be inside the HUD region (see hud.h). Nothing
+ *                  is drawn while no HUD region is set.
+ */
+void smd_perf_bar_draw(const uint16_t x, const uint16_t y, const uint16_t width,
+                       const smd_plane_cell cell);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMD_PERF_H */
@@ -14,28 +14,79 @@
 #include "plane.h"
 #include "dma.h"
 #include "mem_map.h"
+#include "sys.h"
 #include "vdp.h"
 
+/**
+ * \brief           Get the row shift of a plane
+ * \param[in]       plane: Plane to address
+ * \return          log2 of the plane width in cells
+ */
+static inline uint16_t
+smd_plane_row_shift(const smd_plane_t plane) {
+    /* Window plane width depends on the H32/H40 mode */
+    return (plane == SMD_PLANE_W) ? smd_vdp_window_width_shift_get() : smd_vdp_plane_width_shift_get();
+}
+
+/**
+ * \brief           Get the size of a plane
+ * \param[in]       plane: Plane to check
+ * \return          Plane size in cells
+ */
+static inline uint16_t
+smd_plane_tiles(const smd_plane_t plane) {
+    /* Window plane is always 32 cells high */
+    if (plane == SMD_PLANE_W) {
+        return 32 << smd_vdp_window_width_shift_get();
+    }
+    return 1 << (smd_vdp_plane_width_shift_get() + smd_vdp_plane_height_shift_get());
+}
+
 inline smd_plane_cell
 smd_plane_cell_make(const smd_plane_cell_desc_t *restrict cell_desc) {
+    /* Cells count 8x16 tiles in interlace mode 2 */
+    const uint16_t tile_index = (smd_vdp_interlace_get() == SMD_VDP_INTERLACE_2) ? cell_desc->tile_index >> 1
+                                                                                 : cell_desc->tile_index;
+
     return (cell_desc->priority << 15) | (cell_desc->palette << 13) | (cell_desc->v_flip << 12)
-           | (cell_desc->h_flip << 11) | cell_desc->tile_index;
+           | (cell_desc->h_flip << 11) | tile_index;
+}
+
+inline smd_plane_cell
+smd_plane_cell_priority_set(const smd_plane_cell cell, const uint16_t priority) {
+    return (cell & 0x7FFF) | (priority << 15);
+}
+
+void
+smd_plane_cells_priority_set(smd_plane_cell *restrict cells, const uint16_t count, const uint16_t priority) {
+    for (uint16_t i = 0; i < count; ++i) {
+        cells[i] = smd_plane_cell_priority_set(cells[i], priority);
+    }
 }
 
 inline void
 smd_plane_clear(const smd_plane_t plane) {
-    smd_dma_vram_fill(plane, SMD_VDP_PLANE_TILES << 1, 0x00, 1);
+    smd_dma_vram_fill(plane, smd_plane_tiles(plane) << 1, 0x00, 1);
+}
+
+inline void
+smd_plane_clear_enqueue(const smd_plane_t plane) {
+    smd_dma_vram_fill_enqueue(plane, smd_plane_tiles(plane) << 1, 0x00, 1, SMD_DMA_PRIORITY_NORMAL);
 }
 
 void
 smd_plane_cell_draw(const smd_plane_draw_desc_t *restrict draw_desc) {
     uint16_t vram_addr;
+    uint16_t sr;
 
     /* It doesn't make sense to use DMA for only one tile. Write it directly  */
-    vram_addr = draw_desc->plane + ((draw_desc->x + (draw_desc->y * SMD_VDP_PLANE_WIDTH)) << 1);
+    vram_addr = draw_desc->plane + ((draw_desc->x + (draw_desc->y << smd_plane_row_shift(draw_desc->plane))) << 1);
+    /* An interrupt using the VDP would change the write address */
+    sr = smd_sys_ints_save();
     *SMD_VDP_CTRL_PORT_U32 = (((uint32_t)(SMD_VDP_VRAM_WRITE_CMD)) | (((uint32_t)(vram_addr) & 0x3FFF) << 16)
                               | ((uint32_t)(vram_addr) >> 14));
     *SMD_VDP_DATA_PORT_U16 = draw_desc->cell;
+    smd_sys_ints_restore(sr);
 }
 
 void
@@ -43,7 +94,7 @@ smd_plane_row_draw(const smd_dma_transfer_ft dma_func, const smd_plane_draw_desc
 
     dma_func(
         &(smd_dma_transfer_t){.src = (uint16_t *)draw_desc->cells,
-                              .dest = draw_desc->plane + ((draw_desc->x + (draw_desc->y * SMD_VDP_PLANE_WIDTH)) << 1),
+                              .dest = draw_desc->plane + ((draw_desc->x + (draw_desc->y << smd_plane_row_shift(draw_desc->plane))) << 1),
                               .size = draw_desc->length,
                               .inc = 2,
                               .type = SMD_DMA_VRAM_TRANSFER});
@@ -53,9 +104,9 @@ void
 smd_plane_column_draw(const smd_dma_transfer_ft dma_func, const smd_plane_draw_desc_t *restrict draw_desc) {
     dma_func(
         &(smd_dma_transfer_t){.src = (uint16_t *) draw_desc->cells,
-                            .dest = draw_desc->plane + ((draw_desc->x + (draw_desc->y * SMD_VDP_PLANE_WIDTH)) << 1),
+                            .dest = draw_desc->plane + ((draw_desc->x + (draw_desc->y << smd_plane_row_shift(draw_desc->plane))) << 1),
                             .size = draw_desc->length,
-                            .inc = SMD_VDP_PLANE_WIDTH << 1,
+                            .inc = 2 << smd_plane_row_shift(draw_desc->plane),
                             .type = SMD_DMA_VRAM_TRANSFER});
 }
 
@@ -64,7 +115,7 @@ smd_plane_rect_draw(const smd_dma_transfer_ft dma_func, const smd_plane_draw_des
     for (uint16_t row = 0; row < draw_desc->height; ++row) {
         dma_func(
             &(smd_dma_transfer_t){.src = (uint16_t *) draw_desc->cells + (row * draw_desc->width),
-                                    .dest = draw_desc->plane + ((draw_desc->x + ((draw_desc->y + row) * SMD_VDP_PLANE_WIDTH)) << 1),
+                                    .dest = draw_desc->plane + ((draw_desc->x + ((draw_desc->y + row) << smd_plane_row_shift(draw_desc->plane))) << 1),
                                     .size = draw_desc->width,
                                     .inc = 2,
                                     .type = SMD_DMA_VRAM_TRANSFER});
@@ -73,7 +124,8 @@ smd_plane_rect_draw(const smd_dma_transfer_ft dma_func, const smd_plane_draw_des
 
 void
 smd_plane_rect_fill(const smd_plane_draw_desc_t *restrict draw_desc) {
-    uint16_t tile_row[SMD_VDP_PLANE_WIDTH];
+    /* Widest plane size */
+    uint16_t tile_row[128];
 
     /* Setup tile buffer */
     for (uint16_t i = 0; i < draw_desc->width; ++i) {
@@ -81,9 +133,9 @@ smd_plane_rect_fill(const smd_plane_draw_desc_t *restrict draw_desc) {
     }
     /* Draws rows in the plane */
     for (uint16_t i = 0; i < draw_desc->height; ++i) {
-        /* x, y, i and SMD_VDP_PLANE_WIDTH are in tiles, convert to words */
+        /* x, y, i and the plane width are in tiles, convert to words */
         smd_dma_transfer_fast(&(smd_dma_transfer_t){.src = &tile_row,
-                                        .dest = draw_desc->plane + ((draw_desc->x + ((draw_desc->y + i) * SMD_VDP_PLANE_WIDTH)) << 1),
+                                        .dest = draw_desc->plane + ((draw_desc->x + ((draw_desc->y + i) << smd_plane_row_shift(draw_desc->plane))) << 1),
                                         .size = draw_desc->width,
                                         .inc = 2,
                                         .type = SMD_DMA_VRAM_TRANSFER});
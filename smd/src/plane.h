@@ -99,6 +99,28 @@ typedef struct smd_plane_draw_desc_t {
  */
 smd_plane_cell smd_plane_cell_make(const smd_plane_cell_desc_t *restrict cell_desc);
 
+/**
+ * \brief           Set the priority flag of a plane cell
+ *
+ * In shadow/highlight mode, high priority cells are drawn lit (normal colors)
+ * and low priority ones are drawn shadowed.
+ *
+ * \param[in]       cell: Plane cell to change
+ * \param[in]       priority: Priority flag, 1 for lit and 0 for shadowed cells
+ * \return          Plane cell with the new priority
+ */
+smd_plane_cell smd_plane_cell_priority_set(const smd_plane_cell cell, const uint16_t priority);
+
+/**
+ * \brief           Set the priority flag of a buffer of plane cells
+ * \param[in, out]  cells: Plane cells to change
+ * \param[in]       count: Amount of cells to change
+ * \param[in]       priority: Priority flag, 1 for lit and 0 for shadowed cells
+ * \note            Use it to mark lit and shadowed areas of a map before
+ *                  drawing it in shadow/highlight mode.
+ */
+void smd_plane_cells_priority_set(smd_plane_cell *restrict cells, const uint16_t count, const uint16_t priority);
+
 /**
  * \brief           Clear an entire VDP plane using DMA
  * \param[in]       plane: Plane to clear
@@ -108,6 +130,14 @@ smd_plane_cell smd_plane_cell_make(const smd_plane_cell_desc_t *restrict cell_de
  */
 void smd_plane_clear(const smd_plane_t plane);
 
+/**
+ * \brief           Enqueue the clear of an entire VDP plane in the DMA queue
+ * \param[in]       plane: Plane to clear
+ * \note            The plane is cleared in the next DMA queue flush, so it can
+ *                  be done in the vertical blank along with other transfers.
+ */
+void smd_plane_clear_enqueue(const smd_plane_t plane);
+
 /**
  * \brief           Draw a cell in a concrete plane position
  * \param[in]       draw_desc: Cell drawing operation description
@@ -0,0 +1,293 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            raster.c
+ * \brief           Raster effects using the horizontal blank interrupt
+ */
+
+#include "raster.h"
+#include "kdebug.h"
+#include "mem_map.h"
+#include "sys.h"
+#include "vdp.h"
+
+/**
+ * \brief           Raster entry, an already encoded VDP write
+ */
+typedef struct smd_raster_entry_t {
+    uint32_t ctrl;              /**< Control port command (register writes use the low word) */
+    uint16_t data;              /**< Data port write, not used by register writes */
+    uint8_t line;               /**< Raster line where the write is done */
+    bool is_reg;                /**< Is it a register write? */
+} smd_raster_entry_t;
+
+/**
+ * \brief           Raster step, the work done on each horizontal interrupt
+ */
+typedef struct smd_raster_step_t {
+    uint8_t end;                /**< Index of the first entry not run on this step */
+    uint8_t rate;               /**< Interrupt rate written for the step after next */
+} smd_raster_step_t;
+
+/**
+ * \brief           Raster entries list with its interrupt steps
+ */
+typedef struct smd_raster_list_t {
+    smd_raster_entry_t entries[SMD_RASTER_MAX];
+    smd_raster_step_t steps[SMD_RASTER_MAX + 2];
+    uint8_t count;              /**< Amount of entries */
+    uint8_t top_count;          /**< Amount of line 0 entries, run on the vertical blank */
+    uint8_t step_count;         /**< Amount of interrupt steps */
+} smd_raster_list_t;
+
+/**
+ * \brief           Double buffered raster lists
+ */
+static smd_raster_list_t smd_raster_lists[2];
+static smd_raster_list_t *smd_raster_back;
+static smd_raster_list_t *smd_raster_front;
+
+/**
+ * \brief           Has the back list been finished and is waiting to be used?
+ */
+static volatile bool smd_raster_ready;
+
+/**
+ * \brief           Are raster effects running?
+ */
+static bool smd_raster_enabled;
+
+/**
+ * \brief           Current position of the horizontal interrupt in the front list
+ */
+static const smd_raster_entry_t *smd_raster_entry;
+static const smd_raster_step_t *smd_raster_step;
+static const smd_raster_step_t *smd_raster_step_end;
+
+void
+smd_raster_init(void) {
+    smd_raster_lists[0].count = 0;
+    smd_raster_lists[0].top_count = 0;
+    smd_raster_lists[0].step_count = 0;
+    smd_raster_lists[1] = smd_raster_lists[0];
+    smd_raster_back = &smd_raster_lists[0];
+    smd_raster_front = &smd_raster_lists[1];
+    smd_raster_ready = false;
+    smd_raster_enabled = false;
+    smd_raster_entry = nullptr;
+    smd_raster_step = nullptr;
+    smd_raster_step_end = nullptr;
+}
+
+void
+smd_raster_enable(void) {
+    smd_kdebug_warning_if(smd_vdp_blank_lines_get() != 0, "Display lines blanking running at smd_raster_enable");
+    if (smd_vdp_blank_lines_get() != 0) {
+        return;
+    }
+    smd_raster_enabled = true;
+    /* H interrupt on, the rate is set in each vblank */
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_1, smd_vdp_reg_get(SMD_VDP_REG_MODESET_1) | 0x10);
+}
+
+void
+smd_raster_disable(void) {
+    bool ints_enabled;
+
+    ints_enabled = smd_sys_ints_status();
+    smd_sys_ints_disable();
+    smd_raster_enabled = false;
+    smd_raster_step = smd_raster_step_end;
+    /* The interrupt writes the rate directly, so the shadow is out of sync */
+    smd_vdp_reg_write(SMD_VDP_REG_HBLANK_RATE, 0xFF);
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_1, smd_vdp_reg_get(SMD_VDP_REG_MODESET_1) & ~0x10);
+    if (ints_enabled) {
+        smd_sys_ints_enable();
+    }
+}
+
+inline bool
+smd_raster_is_enabled(void) {
+    return smd_raster_enabled;
+}
+
+void
+smd_raster_begin(void) {
+    bool ints_enabled;
+
+    /* A finished list not used yet is replaced by the new one */
+    ints_enabled = smd_sys_ints_status();
+    smd_sys_ints_disable();
+    smd_raster_ready = false;
+    smd_raster_back->count = 0;
+    if (ints_enabled) {
+        smd_sys_ints_enable();
+    }
+}
+
+/**
+ * \brief           Add an entry to the back raster list
+ * \param[in]       entry: Entry to add
+ * \return          true on success, false if the list is full or unsorted
+ */
+static bool
+smd_raster_entry_add(const smd_raster_entry_t *restrict entry) {
+    smd_raster_list_t *list = smd_raster_back;
+
+    if (list->count >= SMD_RASTER_MAX
+        || (list->count > 0 && list->entries[list->count - 1].line > entry->line)) {
+        smd_kdebug_warning_if(true, "Raster list full or unsorted at smd_raster_entry_add");
+        return false;
+    }
+    list->entries[list->count] = *entry;
+    ++list->count;
+    return true;
+}
+
+bool
+smd_raster_reg_add(const uint8_t line, const uint16_t reg, const uint8_t value) {
+    return smd_raster_entry_add( &(smd_raster_entry_t) {
+        .ctrl = reg | value,
+        .data = 0,
+        .line = line,
+        .is_reg = true
+    });
+}
+
+bool
+smd_raster_color_add(const uint8_t line, const uint8_t index, const uint16_t color) {
+    const uint16_t addr = index << 1;
+
+    return smd_raster_entry_add( &(smd_raster_entry_t) {
+        .ctrl = SMD_VDP_CRAM_WRITE_CMD | ((uint32_t) addr << 16),
+        .data = color,
+        .line = line,
+        .is_reg = false
+    });
+}
+
+bool
+smd_raster_vsram_add(const uint8_t line, const uint8_t index, const uint16_t value) {
+    const uint16_t addr = index << 1;
+
+    return smd_raster_entry_add( &(smd_raster_entry_t) {
+        .ctrl = SMD_VDP_VSRAM_WRITE_CMD | ((uint32_t) addr << 16),
+        .data = value,
+        .line = line,
+        .is_reg = false
+    });
+}
+
+void
+smd_raster_end(void) {
+    smd_raster_list_t *list = smd_raster_back;
+    /* Lines of the interrupts, the first two only prime the rate pipeline */
+    uint8_t lines[SMD_RASTER_MAX + 2];
+    uint8_t line_count = 2;
+    uint8_t i = 0;
+
+    /* Line 0 entries are run on the vertical blank */
+    while (i < list->count && list->entries[i].line == 0) {
+        ++i;
+    }
+    list->top_count = i;
+
+    /* Build the interrupt lines: 1, 2 and then each line with work */
+    lines[0] = 1;
+    lines[1] = 2;
+    for (; i < list->count; ++i) {
+        if (list->entries[i].line > lines[line_count - 1]) {
+            lines[line_count] = list->entries[i].line;
+            ++line_count;
+        }
+    }
+
+    /*
+     * Each step runs the entries of its line and writes the rate used after
+     * the next interrupt, that is, the distance between the next two steps.
+     */
+    list->step_count = (list->top_count < list->count) ? line_count : 0;
+    i = list->top_count;
+    for (uint8_t step = 0; step < list->step_count; ++step) {
+        while (i < list->count && list->entries[i].line <= lines[step]) {
+            ++i;
+        }
+        list->steps[step].end = i;
+        list->steps[step].rate = (step + 2 < line_count) ? lines[step + 2] - lines[step + 1] - 1 : 0xFF;
+    }
+
+    /* The list is swapped in the next vertical blank */
+    smd_raster_ready = true;
+}
+
+/**
+ * \brief           Issue a raster entry VDP write
+ * \param[in]       entry: Entry to issue
+ */
+static inline void
+smd_raster_entry_issue(const smd_raster_entry_t *restrict entry) {
+    uint16_t sr;
+
+    if (entry->is_reg) {
+        *SMD_VDP_CTRL_PORT_U16 = (uint16_t) entry->ctrl;
+    } else {
+        /* A vblank interrupt between the writes would change the write address */
+        sr = smd_sys_ints_save();
+        *SMD_VDP_CTRL_PORT_U32 = entry->ctrl;
+        *SMD_VDP_DATA_PORT_U16 = entry->data;
+        smd_sys_ints_restore(sr);
+    }
+}
+
+void
+smd_raster_vint_update(void) {
+    smd_raster_list_t *list;
+
+    if (!smd_raster_enabled) {
+        return;
+    }
+    /* Swap the lists if the game finished a new one */
+    if (smd_raster_ready) {
+        list = smd_raster_front;
+        smd_raster_front = smd_raster_back;
+        smd_raster_back = list;
+        smd_raster_back->count = 0;
+        smd_raster_ready = false;
+    }
+    list = smd_raster_front;
+
+    for (uint8_t i = 0; i < list->top_count; ++i) {
+        smd_raster_entry_issue(&list->entries[i]);
+    }
+    smd_raster_entry = &list->entries[list->top_count];
+    smd_raster_step = &list->steps[0];
+    smd_raster_step_end = &list->steps[list->step_count];
+
+    /*
+     * The counter is reloaded on each vblank line, so the first two interrupts
+     * come on lines 1 and 2
+     */
+    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_HBLANK_RATE | (list->step_count ? 0x00 : 0xFF);
+}
+
+void
+smd_raster_hint_update(void) {
+    const smd_raster_entry_t *end;
+
+    if (smd_raster_step == smd_raster_step_end) {
+        return;
+    }
+    end = &smd_raster_front->entries[smd_raster_step->end];
+    while (smd_raster_entry < end) {
+        smd_raster_entry_issue(smd_raster_entry);
+        ++smd_raster_entry;
+    }
+    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_HBLANK_RATE | smd_raster_step->rate;
+    ++smd_raster_step;
+}
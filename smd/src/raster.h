@@ -0,0 +1,133 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            raster.h
+ * \brief           Raster effects using the horizontal blank interrupt
+ *
+ * The VDP can raise an interrupt in the horizontal blank of the raster lines,
+ * letting us change colors, registers or the vertical scroll in the middle of
+ * the frame (water lines, sky gradients, split screens...).
+ * Each frame, the game builds a list of raster entries sorted by line between
+ * smd_raster_begin and smd_raster_end. Lists are double buffered: the finished
+ * list is used from the next vertical blank, while the game builds the next
+ * one. The horizontal interrupt rate is reprogrammed on each interrupt so it
+ * only fires on lines with work.
+ * A new rate is used by the VDP after the next interrupt, so two extra
+ * interrupts are raised at the top of the frame to prime the rate pipeline.
+ *
+ * The horizontal interrupt writes the VDP control port in the middle of the
+ * frame, as the vertical blank interrupt does with the deferred registers and
+ * the DMA queue, and the display lines blanking does with its registers. An
+ * interrupt between the control port writes of a VRAM address or a DMA start
+ * and their data writes corrupts them, so the library masks the interrupts
+ * around these sequences (DMA, plane cells, VDP rams clear). Code writing the
+ * VDP ports directly must do the same with smd_sys_ints_save and
+ * smd_sys_ints_restore. Masked sequences delay the raster effects, so keep
+ * them short while raster effects are running.
+ */
+
+#ifndef SMD_RASTER_H
+#define SMD_RASTER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief           Default maximum amount of raster entries per frame
+ */
+#ifndef SMD_RASTER_MAX
+    #define SMD_RASTER_MAX (64)
+#endif
+
+/**
+ * \brief           Initialise the raster effects system
+ * \note            This function is called from the boot process so maybe you
+ *                  don't need to call it anymore.
+ */
+void smd_raster_init(void);
+
+/**
+ * \brief           Turn on the raster effects
+ *
+ * Enables the horizontal interrupt. Raster effects can't be used while the
+ * display lines blanking (smd_vdp_blank_lines_set) is running, as both use the
+ * horizontal interrupt.
+ */
+void smd_raster_enable(void);
+
+/**
+ * \brief           Turn off the raster effects and the horizontal interrupt
+ */
+void smd_raster_disable(void);
+
+/**
+ * \brief           Tell if the raster effects are running
+ * \return          true if raster effects are enabled, false otherwise
+ */
+bool smd_raster_is_enabled(void);
+
+/**
+ * \brief           Start building the raster entries list for the next frame
+ */
+void smd_raster_begin(void);
+
+/**
+ * \brief           Add a VDP register write to the raster list
+ * \param[in]       line: Raster line where the change starts
+ * \param[in]       reg: Register to write (SMD_VDP_REG_*)
+ * \param[in]       value: Register value
+ * \return          true on success, false if the list is full or unsorted
+ * \note            The register shadow copy doesn't track raster writes. Use a
+ *                  line 0 entry to restore the register at the top of the frame.
+ */
+bool smd_raster_reg_add(const uint8_t line, const uint16_t reg, const uint8_t value);
+
+/**
+ * \brief           Add a CRAM color write to the raster list
+ * \param[in]       line: Raster line where the change starts
+ * \param[in]       index: Color index (0..63)
+ * \param[in]       color: Color value in BGR format
+ * \return          true on success, false if the list is full or unsorted
+ */
+bool smd_raster_color_add(const uint8_t line, const uint8_t index, const uint16_t color);
+
+/**
+ * \brief           Add a VSRAM write to the raster list
+ * \param[in]       line: Raster line where the change starts
+ * \param[in]       index: VSRAM word index (0..39)
+ * \param[in]       value: Vertical scroll value
+ * \return          true on success, false if the list is full or unsorted
+ */
+bool smd_raster_vsram_add(const uint8_t line, const uint8_t index, const uint16_t value);
+
+/**
+ * \brief           Finish the raster entries list, it is used from the next vertical blank
+ */
+void smd_raster_end(void);
+
+/**
+ * \brief           Update the raster effects on the vertical blank interrupt
+ * \note            Called from the vertical blank interrupt handler
+ */
+void smd_raster_vint_update(void);
+
+/**
+ * \brief           Run the raster entries of the current line
+ * \note            Called from the horizontal blank interrupt handler
+ */
+void smd_raster_hint_update(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMD_RASTER_H */
@@ -0,0 +1,241 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            scroll.c
+ * \brief           Planes scrolling
+ */
+
+#include "scroll.h"
+#include "dma.h"
+#include "vdp.h"
+
+/**
+ * \brief           Horizontal scroll values ram copy for planes A and B
+ */
+static int16_t smd_scroll_h_table[2][SMD_SCROLL_H_ENTRIES];
+
+/**
+ * \brief           Dirty range of horizontal scroll entries for each plane
+ * \note            The range is empty when first is greater than last
+ */
+static uint16_t smd_scroll_h_dirty_first[2];
+static uint16_t smd_scroll_h_dirty_last[2];
+
+/**
+ * \brief           Vertical scroll values ram copy for planes A and B
+ */
+static int16_t smd_scroll_v_table[2][SMD_SCROLL_V_COLUMNS];
+
+/**
+ * \brief           Changed vertical scroll columns for each plane (one bit each)
+ */
+static uint32_t smd_scroll_v_dirty[2];
+
+/**
+ * \brief           Add a range of entries to a plane horizontal scroll dirty range
+ * \param[in]       plane: Changed plane
+ * \param[in]       first: First changed entry
+ * \param[in]       last: Last changed entry
+ */
+static inline void
+smd_scroll_h_dirty_add(const smd_scroll_plane_t plane, const uint16_t first, const uint16_t last) {
+    if (first < smd_scroll_h_dirty_first[plane]) {
+        smd_scroll_h_dirty_first[plane] = first;
+    }
+    if (last > smd_scroll_h_dirty_last[plane]) {
+        smd_scroll_h_dirty_last[plane] = last;
+    }
+}
+
+void
+smd_scroll_init(void) {
+    for (uint16_t i = 0; i < SMD_SCROLL_H_ENTRIES; ++i) {
+        smd_scroll_h_table[SMD_SCROLL_PLANE_A][i] = 0;
+        smd_scroll_h_table[SMD_SCROLL_PLANE_B][i] = 0;
+    }
+    for (uint16_t i = 0; i < SMD_SCROLL_V_COLUMNS; ++i) {
+        smd_scroll_v_table[SMD_SCROLL_PLANE_A][i] = 0;
+        smd_scroll_v_table[SMD_SCROLL_PLANE_B][i] = 0;
+    }
+    /* VRAM and VSRAM are already cleared by smd_vdp_init, nothing to upload */
+    for (uint16_t i = 0; i < 2; ++i) {
+        smd_scroll_h_dirty_first[i] = 0xFFFF;
+        smd_scroll_h_dirty_last[i] = 0;
+        smd_scroll_v_dirty[i] = 0;
+    }
+}
+
+inline void
+smd_scroll_h_set(const smd_scroll_plane_t plane, const uint16_t index, const int16_t value) {
+    smd_scroll_h_table[plane][index] = value;
+    smd_scroll_h_dirty_add(plane, index, index);
+}
+
+inline int16_t
+smd_scroll_h_get(const smd_scroll_plane_t plane, const uint16_t index) {
+    return smd_scroll_h_table[plane][index];
+}
+
+void
+smd_scroll_h_fill(const smd_scroll_plane_t plane, const uint16_t index, const uint16_t count,
+                  const int16_t value) {
+    int16_t *entry = &smd_scroll_h_table[plane][index];
+
+    if (count == 0) {
+        return;
+    }
+    for (uint16_t i = 0; i < count; ++i) {
+        entry[i] = value;
+    }
+    smd_scroll_h_dirty_add(plane, index, index + count - 1);
+}
+
+void
+smd_scroll_h_ramp(const smd_scroll_plane_t plane, const uint16_t index, const uint16_t count,
+                  const fix32_t start, const fix32_t step) {
+    int16_t *entry = &smd_scroll_h_table[plane][index];
+    fix32_t value = start;
+
+    if (count == 0) {
+        return;
+    }
+    for (uint16_t i = 0; i < count; ++i) {
+        entry[i] = fix32_to_int(value);
+        value += step;
+    }
+    smd_scroll_h_dirty_add(plane, index, index + count - 1);
+}
+
+inline void
+smd_scroll_v_set(const smd_scroll_plane_t plane, const uint16_t column, const int16_t value) {
+    if (smd_scroll_v_table[plane][column] != value) {
+        smd_scroll_v_table[plane][column] = value;
+        smd_scroll_v_dirty[plane] |= 1UL << column;
+    }
+}
+
+inline int16_t
+smd_scroll_v_get(const smd_scroll_plane_t plane, const uint16_t column) {
+    return smd_scroll_v_table[plane][column];
+}
+
+void
+smd_scroll_v_plane_set(const smd_scroll_plane_t plane, const int16_t value) {
+    for (uint16_t i = 0; i < SMD_SCROLL_V_COLUMNS; ++i) {
+        smd_scroll_v_set(plane, i, value);
+    }
+}
+
+void
+smd_scroll_v_wave_set(const smd_scroll_plane_t plane, const uint16_t column, const uint16_t count,
+                      const int16_t base, const int8_t *restrict offsets) {
+    for (uint16_t i = 0; i < count; ++i) {
+        smd_scroll_v_set(plane, column + i, base + offsets[i]);
+    }
+}
+
+/**
+ * \brief           Enqueue the changed vertical scroll columns of a plane
+ * \param[in]       plane: Plane to upload
+ * \param[in]       dirty: Changed columns (one bit each)
+ * \return          Enqueued columns (one bit each), the others didn't fit in
+ *                  the DMA queue
+ */
+static uint32_t
+smd_scroll_v_plane_update(const smd_scroll_plane_t plane, uint32_t dirty) {
+    uint32_t enqueued = 0;
+    uint16_t first = 0;
+    uint16_t count;
+
+    /* Each run of contiguous changed columns goes in its own transfer */
+    while (dirty) {
+        while (!(dirty & 0x01)) {
+            dirty >>= 1;
+            ++first;
+        }
+        count = 0;
+        while (dirty & 0x01) {
+            dirty >>= 1;
+            ++count;
+        }
+        if (smd_dma_queue_size() >= SMD_DMA_QUEUE_SIZE) {
+            break;
+        }
+        /* Plane B words follow the plane A ones on each column */
+        smd_dma_transfer_enqueue( &(smd_dma_transfer_t) {
+            .type = SMD_DMA_VSRAM_TRANSFER,
+            .src = &smd_scroll_v_table[plane][first],
+            .dest = (plane << 1) + (first << 2),
+            .size = count,
+            .inc = 4,
+            .priority = SMD_DMA_PRIORITY_NORMAL
+        });
+        enqueued |= ((1UL << count) - 1) << first;
+        first += count;
+    }
+    return enqueued;
+}
+
+void
+smd_scroll_update(void) {
+    uint16_t first;
+    uint16_t last;
+    uint16_t stride;
+    uint16_t entries;
+
+    /* The table layout in VRAM depends on the horizontal scroll mode */
+    switch (smd_vdp_reg_get(SMD_VDP_REG_MODESET_3) & 0x03) {
+    case SMD_VDP_HSCROLL_LINE:
+        stride = 4;
+        entries = SMD_SCROLL_H_ENTRIES;
+        break;
+    case SMD_VDP_HSCROLL_TILE:
+        stride = 32;
+        entries = SMD_SCROLL_H_ENTRIES >> 3;
+        break;
+    default:
+        stride = 4;
+        entries = 1;
+        break;
+    }
+
+    for (uint16_t plane = 0; plane < 2; ++plane) {
+        first = smd_scroll_h_dirty_first[plane];
+        last = smd_scroll_h_dirty_last[plane];
+        if (last >= entries) {
+            last = entries - 1;
+        }
+        /* A full queue would drop the transfer, so the range is kept for the next update */
+        if (first > last || smd_dma_queue_size() < SMD_DMA_QUEUE_SIZE) {
+            if (first <= last) {
+                /* Plane B words follow the plane A ones on each line */
+                smd_dma_transfer_enqueue( &(smd_dma_transfer_t) {
+                    .type = SMD_DMA_VRAM_TRANSFER,
+                    .src = &smd_scroll_h_table[plane][first],
+                    .dest = SMD_VDP_HSCROLL_TABLE_ADDR + (plane << 1) + first * stride,
+                    .size = last - first + 1,
+                    .inc = stride,
+                    .priority = SMD_DMA_PRIORITY_NORMAL
+                });
+            }
+            smd_scroll_h_dirty_first[plane] = 0xFFFF;
+            smd_scroll_h_dirty_last[plane] = 0;
+        }
+
+        /*
+         * The whole plane uses the first column in plane mode. The other
+         * columns keep their dirty bits until column mode is set again
+         */
+        if (smd_vdp_reg_get(SMD_VDP_REG_MODESET_3) & SMD_VDP_VSCROLL_TILE) {
+            smd_scroll_v_dirty[plane] &= ~smd_scroll_v_plane_update(plane, smd_scroll_v_dirty[plane]);
+        } else {
+            smd_scroll_v_dirty[plane] &= ~smd_scroll_v_plane_update(plane, smd_scroll_v_dirty[plane] & 0x01);
+        }
+    }
+}
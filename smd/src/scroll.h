@@ -0,0 +1,163 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * This file is part of The Curse of Issyos MegaDrive port.
+ * Coded by: Juan Ángel Moreno Fernández (@_tapule) 2024
+ * Github: https://github.com/tapule
+ */
+
+/**
+ * \file            scroll.h
+ * \brief           Planes scrolling
+ *
+ * The VDP reads the horizontal scroll values of planes A and B from a table in
+ * VRAM (SMD_VDP_HSCROLL_TABLE_ADDR). Each raster line has two words on it, one
+ * for plane A and one for plane B. Depending on the horizontal scroll mode, the
+ * VDP uses only the first line (plane mode), the first line of each tile row
+ * (tile mode) or all lines (line mode).
+ * A ram copy of the values used by the current mode is kept for each plane.
+ * Changed entries are tracked as a dirty range per plane and only that range is
+ * uploaded through the DMA queue by smd_scroll_update.
+ * Vertical scroll values are stored in VSRAM, interleaving plane A and plane B
+ * words for each two cells wide column. The whole plane (plane mode) uses the
+ * first column values. Their ram copy tracks changed columns per plane, so only
+ * changed words are uploaded.
+ */
+
+#ifndef SMD_SCROLL_H
+#define SMD_SCROLL_H
+
+#include <stdint.h>
+#include "fix32.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief           Maximum horizontal scroll entries per plane (one per line in V30 mode)
+ */
+#define SMD_SCROLL_H_ENTRIES (240)
+
+/**
+ * \brief           Vertical scroll columns per plane (two cells wide each)
+ */
+#define SMD_SCROLL_V_COLUMNS (20)
+
+/**
+ * \brief           Planes with scroll values
+ */
+typedef enum smd_scroll_plane_t {
+    SMD_SCROLL_PLANE_A = 0,
+    SMD_SCROLL_PLANE_B = 1
+} smd_scroll_plane_t;
+
+/**
+ * \brief           Initialise the scroll system
+ * \note            This function is called from the boot process so maybe you
+ *                  don't need to call it anymore.
+ */
+void smd_scroll_init(void);
+
+/**
+ * \brief           Set a plane horizontal scroll value
+ * \param[in]       plane: Plane to scroll
+ * \param[in]       index: Entry to set. Line or tile row depending on the
+ *                  horizontal scroll mode (always 0 in plane mode)
+ * \param[in]       value: Horizontal scroll value in pixels
+ * \note            Entries keep their index if the scroll mode changes, so they
+ *                  should be set again after changing it.
+ */
+void smd_scroll_h_set(const smd_scroll_plane_t plane, const uint16_t index, const int16_t value);
+
+/**
+ * \brief           Get a plane horizontal scroll value
+ * \param[in]       plane: Scrolled plane
+ * \param[in]       index: Entry to get (line, tile row or 0)
+ * \return          Horizontal scroll value in pixels
+ */
+int16_t smd_scroll_h_get(const smd_scroll_plane_t plane, const uint16_t index);
+
+/**
+ * \brief           Set a range of plane horizontal scroll entries to the same value
+ * \param[in]       plane: Plane to scroll
+ * \param[in]       index: First entry to set (line, tile row or 0)
+ * \param[in]       count: Amount of entries to set
+ * \param[in]       value: Horizontal scroll value in pixels
+ */
+void smd_scroll_h_fill(const smd_scroll_plane_t plane, const uint16_t index, const uint16_t count,
+                       const int16_t value);
+
+/**
+ * \brief           Set a range of plane horizontal scroll entries to a linear ramp
+ *
+ * Each entry gets the previous entry value plus the step, which is the usual way
+ * to do parallax effects in line or tile scroll modes (i.e. the ground moving
+ * faster as it gets closer to the bottom of the screen).
+ *
+ * \param[in]       plane: Plane to scroll
+ * \param[in]       index: First entry to set (line, tile row or 0)
+ * \param[in]       count: Amount of entries to set
+ * \param[in]       start: First entry value in pixels
+ * \param[in]       step: Value added on each entry in pixels
+ */
+void smd_scroll_h_ramp(const smd_scroll_plane_t plane, const uint16_t index, const uint16_t count,
+                       const fix32_t start, const fix32_t step);
+
+/**
+ * \brief           Set a plane vertical scroll value for a column
+ * \param[in]       plane: Plane to scroll
+ * \param[in]       column: Two cells wide column (0..19), always 0 in plane mode
+ * \param[in]       value: Vertical scroll value in pixels
+ * \note            Columns not used by the current mode aren't uploaded, so they
+ *                  should be set again after changing it.
+ */
+void smd_scroll_v_set(const smd_scroll_plane_t plane, const uint16_t column, const int16_t value);
+
+/**
+ * \brief           Get a plane vertical scroll value for a column
+ * \param[in]       plane: Scrolled plane
+ * \param[in]       column: Two cells wide column (0..19)
+ * \return          Vertical scroll value in pixels
+ */
+int16_t smd_scroll_v_get(const smd_scroll_plane_t plane, const uint16_t column);
+
+/**
+ * \brief           Set the same vertical scroll value to all the plane columns
+ * \param[in]       plane: Plane to scroll
+ * \param[in]       value: Vertical scroll value in pixels
+ * \note            Only the first column is uploaded in plane mode
+ */
+void smd_scroll_v_plane_set(const smd_scroll_plane_t plane, const int16_t value);
+
+/**
+ * \brief           Set the vertical scroll of a range of columns as a base value plus offsets
+ *
+ * Used for column effects like waves, where each column moves around the plane
+ * vertical scroll.
+ *
+ * \param[in]       plane: Plane to scroll
+ * \param[in]       column: First column to set (0..19)
+ * \param[in]       count: Amount of columns to set
+ * \param[in]       base: Vertical scroll value in pixels common to all columns
+ * \param[in]       offsets: Offset in pixels added to the base value on each column
+ */
+void smd_scroll_v_wave_set(const smd_scroll_plane_t plane, const uint16_t column, const uint16_t count,
+                           const int16_t base, const int8_t *restrict offsets);
+
+/**
+ * \brief           Enqueue the changed scroll entries in the DMA queue
+ * \note            Small ranges (see SMD_DMA_CPU_WRITE_THRESHOLD) are copied
+ *                  into the queue, so the ram copy must be considered captured
+ *                  when this function runs. Later changes are uploaded by the
+ *                  next call.
+ * \note            Ranges that don't fit in a full DMA queue keep their dirty
+ *                  state for the next call.
+ */
+void smd_scroll_update(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMD_SCROLL_H */
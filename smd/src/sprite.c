@@ -16,6 +16,7 @@
 #include "kdebug.h"
 #include "vdp.h"
 
+/* Sprite table size in H40 mode, H32 mode only uses 64 entries */
 #define SMD_SPR_MAX 80
 
 /*
@@ -69,13 +70,52 @@ static const uint8_t smd_spr_size_table[16] = {
     16  /* SMD_SPR_SIZE_4X4 - 0b1111 */
 };
 
-/* Sprite table buffer and sprites counter */
-static smd_spr_entry_t smd_spr_table[SMD_SPR_MAX];
+/* Bands of 8 lines (16 in double resolution) checked by the flicker mode */
+#define SMD_SPR_BANDS 32
+
+/*
+ * Double buffered sprite table and immediate sprites counter. The back table
+ * is filled while the front one waits in the DMA queue. Retained slots use the
+ * first entries of both tables and immediate sprites go after them.
+ */
+static smd_spr_entry_t smd_spr_tables[2][SMD_SPR_MAX];
+static smd_spr_entry_t *smd_spr_table;
 static smd_spr_entry_t *smd_spr_next;
 static uint8_t smd_spr_count;
 
+/* Set when a table is enqueued, with the DMA queue sync point that uploads it */
+static bool smd_spr_table_queued;
+static uint16_t smd_spr_table_sync;
+
+/* Retained slots changed since the last upload (one bit each) */
+static uint32_t smd_spr_retained_dirty;
+static_assert(SMD_SPR_RETAINED_MAX <= 32, "Retained sprite slots don't fit in the dirty mask");
+
+/* Flicker mode status and first rotated sprite in the link chain */
+static bool smd_spr_flicker_enabled;
+static uint8_t smd_spr_flicker_offset;
+
+/* Sort mode status, sort key of each sprite and key for the next added ones */
+static bool smd_spr_sort_enabled;
+static uint8_t smd_spr_keys[SMD_SPR_MAX];
+static uint8_t smd_spr_key;
+
 inline void
 smd_spr_init(void) {
+    smd_spr_flicker_enabled = false;
+    smd_spr_flicker_offset = 1;
+    smd_spr_sort_enabled = false;
+    smd_spr_key = 0;
+#if SMD_SPR_RETAINED_MAX > 0
+    /* Unused retained slots are linked out of the screen */
+    for (uint16_t i = 0; i < SMD_SPR_RETAINED_MAX; ++i) {
+        smd_spr_tables[0][i] = (smd_spr_entry_t) {.y = 0, .size = 0, .link = i + 1, .attributes = 0, .x = 0};
+        smd_spr_tables[1][i] = smd_spr_tables[0][i];
+    }
+#endif
+    smd_spr_table = smd_spr_tables[0];
+    smd_spr_table_queued = false;
+    smd_spr_retained_dirty = (SMD_SPR_RETAINED_MAX < 32) ? (1UL << SMD_SPR_RETAINED_MAX) - 1 : 0xFFFFFFFF;
     smd_spr_clear();
 }
 
@@ -100,6 +140,18 @@ smd_spr_attributes_hflip(uint16_t *attributes) {
     *attributes ^= 0x0800;
 }
 
+inline uint16_t
+smd_spr_operator_attributes_encode(const uint16_t priority, const uint16_t v_flip, const uint16_t h_flip,
+                                   const uint16_t tile_index) {
+    return smd_spr_attributes_encode(priority, SMD_SPR_OPERATOR_PALETTE, v_flip, h_flip, tile_index);
+}
+
+inline void
+smd_spr_operator_tiles_fill(const uint16_t tile_index, const uint16_t count, const smd_spr_operator_t op) {
+    /* Each tile pixel is a nibble and a tile uses 32 bytes */
+    smd_dma_vram_fill(tile_index << 5, count << 5, (op << 4) | op, 1);
+}
+
 inline uint8_t
 smd_spr_size_encode(const uint8_t width, const uint8_t height) {
     return (((height - 1) & 0x03) | (((width - 1) & 0x03) << 2));
@@ -126,50 +178,481 @@ void smd_spr_set_vflag(uint16_t* attributes, const uint16_t v_flip)
 
 void
 smd_spr_add(int16_t x, int16_t y, uint16_t attributes, uint8_t size) {
-    /* Check sprite limit */
-    if (smd_spr_count == SMD_SPR_MAX) {
+    const int16_t height = smd_vdp_screen_height_get();
+
+    /* Check sprite limit (64 in H32 mode, 80 in H40) */
+    if (SMD_SPR_RETAINED_MAX + smd_spr_count >= smd_vdp_sprite_max_get()) {
         return;
     }
     /* Ignore off-screen sprites */
-    if (x <= -32 || x >= 320) {
+    if (x <= -32 || x >= (int16_t) smd_vdp_screen_width_get()) {
         return;
     }
-    if (y <= -32 || y >= 240) {
+    if (smd_vdp_interlace_get() == SMD_VDP_INTERLACE_2) {
+        /*
+         * Double resolution: y uses the doubled screen lines with a 256 offset
+         * and tile indexes count 8x16 tiles
+         */
+        if (y <= -64 || y >= (height << 1)) {
+            return;
+        }
+        y += 128;
+        attributes = (attributes & 0xF800) | ((attributes & 0x07FF) >> 1);
+    } else if (y <= -32 || y >= height) {
         return;
     }
 
     smd_spr_next->y = y + 128;
     smd_spr_next->size = size;
-    smd_spr_next->link = smd_spr_count + 1;
+    smd_spr_next->link = SMD_SPR_RETAINED_MAX + smd_spr_count + 1;
     smd_spr_next->attributes = attributes;
     smd_spr_next->x = x + 128;
+    smd_spr_keys[smd_spr_count] = smd_spr_key;
     ++smd_spr_next;
     ++smd_spr_count;
 }
 
+void
+smd_spr_meta_add(const int16_t x, const int16_t y, const uint16_t attributes,
+                 const smd_spr_meta_t *restrict meta) {
+    const smd_spr_meta_piece_t *piece = meta->pieces;
+    const smd_spr_meta_piece_t *end = piece + meta->count;
+    const int16_t screen_width = smd_vdp_screen_width_get();
+    const int16_t screen_height = smd_vdp_screen_height_get();
+    const uint8_t max = smd_vdp_sprite_max_get() - SMD_SPR_RETAINED_MAX;
+    const bool h_flip = attributes & 0x0800;
+    const bool v_flip = attributes & 0x1000;
+    smd_spr_entry_t *next = smd_spr_next;
+    uint8_t count = smd_spr_count;
+    int16_t width;
+    int16_t height;
+    int16_t px;
+    int16_t py;
+
+    /* Double resolution uses 8x16 tiles and needs the generic path */
+    if (smd_vdp_interlace_get() == SMD_VDP_INTERLACE_2) {
+        for (; piece < end; ++piece) {
+            width = ((piece->size & 0x0C) + 4) << 1;
+            height = ((piece->size & 0x03) + 1) << 4;
+            px = h_flip ? x - piece->x - width : x + piece->x;
+            py = v_flip ? y - piece->y - height : y + piece->y;
+            smd_spr_add(px, py, attributes + piece->tile, piece->size);
+        }
+        return;
+    }
+
+    for (; piece < end; ++piece) {
+        /* Size is 0000hhvv, width and height in tiles minus one */
+        width = ((piece->size & 0x0C) + 4) << 1;
+        height = ((piece->size & 0x03) + 1) << 3;
+        px = h_flip ? x - piece->x - width : x + piece->x;
+        py = v_flip ? y - piece->y - height : y + piece->y;
+        if (px <= -width || px >= screen_width || py <= -height || py >= screen_height) {
+            continue;
+        }
+        if (count >= max) {
+            break;
+        }
+        next->y = py + 128;
+        next->size = piece->size;
+        next->link = SMD_SPR_RETAINED_MAX + count + 1;
+        next->attributes = attributes + piece->tile;
+        next->x = px + 128;
+        smd_spr_keys[count] = smd_spr_key;
+        ++next;
+        ++count;
+    }
+    smd_spr_next = next;
+    smd_spr_count = count;
+}
+
 inline void
 smd_spr_clear(void) {
     smd_spr_count = 0;
-    smd_spr_next = &smd_spr_table[0];
+    smd_spr_next = &smd_spr_table[SMD_SPR_RETAINED_MAX];
     smd_spr_next->x = 0;
     smd_spr_next->link = 0;
 }
 
+inline void
+smd_spr_flicker_set(const bool enabled) {
+    smd_spr_flicker_enabled = enabled;
+}
+
+inline bool
+smd_spr_flicker_get(void) {
+    return smd_spr_flicker_enabled;
+}
+
+/**
+ * \brief           Get the worst sprites excess over the VDP line limits
+ * \return          Sprites to drop in the most loaded band, 0 if none
+ */
+static uint16_t
+smd_spr_excess_get(void) {
+    uint8_t sprites[SMD_SPR_BANDS] = {0};
+    /* 80 sprites up to 4 tiles wide can reach 320 tiles in a band */
+    uint16_t tiles[SMD_SPR_BANDS] = {0};
+    const uint16_t sprite_limit = smd_vdp_is_h40() ? 20 : 16;
+    const uint16_t tile_limit = smd_vdp_is_h40() ? 40 : 32;
+    /* Double resolution sprites use doubled lines and 16 lines tall tiles */
+    const uint16_t shift = (smd_vdp_interlace_get() == SMD_VDP_INTERLACE_2) ? 4 : 3;
+    const smd_spr_entry_t *entry = smd_spr_table;
+    const smd_spr_entry_t *end = &smd_spr_table[SMD_SPR_RETAINED_MAX + smd_spr_count];
+    uint16_t excess = 0;
+    int16_t first;
+    int16_t last;
+    uint8_t width;
+
+    /* Retained slots are checked too, unused ones are out of the screen */
+    /* Bands are a conservative approximation, a sprite counts on all their lines */
+    for (; entry < end; ++entry) {
+        /* Entries store y + 128, or y + 256 in double resolution */
+        first = (entry->y - (128 << (shift - 3))) >> shift;
+        last = ((entry->y - (128 << (shift - 3)) + (((entry->size & 0x03) + 1) << shift)) - 1) >> shift;
+        first = (first < 0) ? 0 : first;
+        last = (last >= SMD_SPR_BANDS) ? SMD_SPR_BANDS - 1 : last;
+        width = ((entry->size >> 2) & 0x03) + 1;
+        for (int16_t band = first; band <= last; ++band) {
+            ++sprites[band];
+            tiles[band] += width;
+        }
+    }
+    for (uint16_t band = 0; band < SMD_SPR_BANDS; ++band) {
+        if (sprites[band] > sprite_limit && sprites[band] - sprite_limit > excess) {
+            excess = sprites[band] - sprite_limit;
+        }
+        if (tiles[band] > tile_limit && excess == 0) {
+            excess = 1;
+        }
+    }
+    return excess;
+}
+
+/**
+ * \brief           Get the link chain rotation for the current frame
+ * \return          First rotated position in the chain, 1 if there is no rotation
+ */
+static uint16_t
+smd_spr_flicker_offset_update(void) {
+    const uint16_t excess = smd_spr_excess_get();
+    uint16_t offset;
+
+    if (excess == 0) {
+        return 1;
+    }
+    /* Offset goes from 1 (no rotation) to count - 1 */
+    offset = smd_spr_flicker_offset + excess;
+    while (offset >= smd_spr_count) {
+        offset -= smd_spr_count - 1;
+    }
+    smd_spr_flicker_offset = offset;
+    return offset;
+}
+
+inline void
+smd_spr_sort_set(const bool enabled) {
+    smd_spr_sort_enabled = enabled;
+}
+
+inline bool
+smd_spr_sort_get(void) {
+    return smd_spr_sort_enabled;
+}
+
+inline void
+smd_spr_key_set(const uint8_t key) {
+    smd_spr_key = key;
+}
+
+/**
+ * \brief           Sort the sprites by key
+ * \param[out]      order: Sprite table indexes in drawing order
+ *
+ * LSD radix sort using two 4 bits passes over the inverted keys, which is stable
+ * and gets the higher keys first. The first sorted sprite is moved to the first
+ * table entry.
+ */
+static void
+smd_spr_sort(uint8_t *restrict order) {
+    uint8_t temp[SMD_SPR_MAX];
+    uint8_t offsets[16];
+    smd_spr_entry_t *table = &smd_spr_table[SMD_SPR_RETAINED_MAX];
+    smd_spr_entry_t entry;
+    uint8_t digit;
+    uint8_t first;
+
+    /* First pass, low nibble from adding order */
+    for (uint16_t i = 0; i < 16; ++i) {
+        offsets[i] = 0;
+    }
+    for (uint16_t i = 0; i < smd_spr_count; ++i) {
+        ++offsets[~smd_spr_keys[i] & 0x0F];
+    }
+    for (uint16_t i = 0, sum = 0; i < 16; ++i) {
+        digit = offsets[i];
+        offsets[i] = sum;
+        sum += digit;
+    }
+    for (uint16_t i = 0; i < smd_spr_count; ++i) {
+        temp[offsets[~smd_spr_keys[i] & 0x0F]++] = i;
+    }
+
+    /* Second pass, high nibble */
+    for (uint16_t i = 0; i < 16; ++i) {
+        offsets[i] = 0;
+    }
+    for (uint16_t i = 0; i < smd_spr_count; ++i) {
+        ++offsets[(~smd_spr_keys[i] >> 4) & 0x0F];
+    }
+    for (uint16_t i = 0, sum = 0; i < 16; ++i) {
+        digit = offsets[i];
+        offsets[i] = sum;
+        sum += digit;
+    }
+    for (uint16_t i = 0; i < smd_spr_count; ++i) {
+        order[offsets[(~smd_spr_keys[temp[i]] >> 4) & 0x0F]++] = temp[i];
+    }
+
+    /* The VDP starts the chain on the first entry, swap it with the first sorted one */
+    first = order[0];
+    if (first != 0) {
+        entry = table[0];
+        table[0] = table[first];
+        table[first] = entry;
+        digit = smd_spr_keys[0];
+        smd_spr_keys[0] = smd_spr_keys[first];
+        smd_spr_keys[first] = digit;
+        for (uint16_t i = 1; i < smd_spr_count; ++i) {
+            if (order[i] == 0) {
+                order[i] = first;
+                break;
+            }
+        }
+        order[0] = 0;
+    }
+}
+
+/**
+ * \brief           Build the immediate sprites link chain
+ *
+ * Without sorting, the chain is the adding order and a flicker rotation only
+ * changes three links: 0, offset, offset + 1, ..., count - 1, 1, ..., offset - 1
+ * (positions relative to the first immediate sprite). Sorted chains are fully
+ * relinked.
+ */
+static void
+smd_spr_link_update(void) {
+    const uint16_t base = SMD_SPR_RETAINED_MAX;
+    const uint16_t offset = (smd_spr_flicker_enabled && smd_spr_count > 2) ? smd_spr_flicker_offset_update() : 1;
+    smd_spr_entry_t *table = &smd_spr_table[base];
+    uint8_t order[SMD_SPR_MAX];
+    uint8_t prev;
+
+    if (!smd_spr_sort_enabled || smd_spr_count < 2) {
+        table[smd_spr_count - 1].link = 0;
+        if (offset > 1) {
+            table[0].link = base + offset;
+            table[smd_spr_count - 1].link = base + 1;
+            table[offset - 1].link = 0;
+        }
+        return;
+    }
+
+    smd_spr_sort(order);
+    prev = order[0];
+    for (uint16_t i = offset; i < smd_spr_count; ++i) {
+        table[prev].link = base + order[i];
+        prev = order[i];
+    }
+    for (uint16_t i = 1; i < offset; ++i) {
+        table[prev].link = base + order[i];
+        prev = order[i];
+    }
+    table[prev].link = 0;
+}
+
+/**
+ * \brief           Mark a retained slot as changed
+ * \param[in]       slot: Changed retained slot
+ */
+static inline void
+smd_spr_retained_dirty_add(const uint16_t slot) {
+    smd_spr_retained_dirty |= 1UL << slot;
+}
+
+void
+smd_spr_retained_set(const uint16_t slot, const int16_t x, int16_t y, uint16_t attributes,
+                     const uint8_t size) {
+#if SMD_SPR_RETAINED_MAX > 0
+    smd_spr_entry_t *entry;
+
+    smd_kdebug_warning_if(slot >= SMD_SPR_RETAINED_MAX, "Invalid retained slot at smd_spr_retained_set");
+    if (slot >= SMD_SPR_RETAINED_MAX) {
+        return;
+    }
+    entry = &smd_spr_table[slot];
+
+    if (smd_vdp_interlace_get() == SMD_VDP_INTERLACE_2) {
+        /* Same double resolution conversion done by smd_spr_add */
+        y += 128;
+        attributes = (attributes & 0xF800) | ((attributes & 0x07FF) >> 1);
+    }
+    if (entry->y == y + 128 && entry->x == x + 128 && entry->attributes == attributes && entry->size == size) {
+        return;
+    }
+    entry->y = y + 128;
+    entry->size = size;
+    entry->attributes = attributes;
+    entry->x = x + 128;
+    smd_spr_retained_dirty_add(slot);
+#else
+    (void) slot;
+    (void) x;
+    (void) y;
+    (void) attributes;
+    (void) size;
+    smd_kdebug_warning_if(true, "No retained slots at smd_spr_retained_set");
+#endif
+}
+
+void
+smd_spr_retained_move(const uint16_t slot, const int16_t x, int16_t y) {
+#if SMD_SPR_RETAINED_MAX > 0
+    smd_spr_entry_t *entry;
+
+    smd_kdebug_warning_if(slot >= SMD_SPR_RETAINED_MAX, "Invalid retained slot at smd_spr_retained_move");
+    if (slot >= SMD_SPR_RETAINED_MAX) {
+        return;
+    }
+    entry = &smd_spr_table[slot];
+
+    if (smd_vdp_interlace_get() == SMD_VDP_INTERLACE_2) {
+        y += 128;
+    }
+    if (entry->y == y + 128 && entry->x == x + 128) {
+        return;
+    }
+    entry->y = y + 128;
+    entry->x = x + 128;
+    smd_spr_retained_dirty_add(slot);
+#else
+    (void) slot;
+    (void) x;
+    (void) y;
+    smd_kdebug_warning_if(true, "No retained slots at smd_spr_retained_move");
+#endif
+}
+
+void
+smd_spr_retained_hide(const uint16_t slot) {
+#if SMD_SPR_RETAINED_MAX > 0
+    smd_spr_entry_t *entry;
+
+    smd_kdebug_warning_if(slot >= SMD_SPR_RETAINED_MAX, "Invalid retained slot at smd_spr_retained_hide");
+    if (slot >= SMD_SPR_RETAINED_MAX) {
+        return;
+    }
+    entry = &smd_spr_table[slot];
+
+    /* Out of the screen, above the first line */
+    if (entry->y == 0 && entry->x == 0) {
+        return;
+    }
+    entry->y = 0;
+    entry->x = 0;
+    smd_spr_retained_dirty_add(slot);
+#else
+    (void) slot;
+    smd_kdebug_warning_if(true, "No retained slots at smd_spr_retained_hide");
+#endif
+}
+
+/**
+ * \brief           Upload the changed retained slots
+ *
+ * The last slot links to the first immediate sprite, or ends the chain if
+ * there are no immediate sprites. Changed slots are also copied to the other
+ * table, already uploaded, so it is up to date when the tables are swapped.
+ */
+static void
+smd_spr_retained_update(void) {
+#if SMD_SPR_RETAINED_MAX > 0
+    const uint8_t link = (smd_spr_count > 0) ? SMD_SPR_RETAINED_MAX : 0;
+    smd_spr_entry_t *other = (smd_spr_table == smd_spr_tables[0]) ? smd_spr_tables[1] : smd_spr_tables[0];
+    uint32_t dirty;
+    uint16_t first = 0;
+    uint16_t count;
+
+    if (smd_spr_table[SMD_SPR_RETAINED_MAX - 1].link != link) {
+        smd_spr_table[SMD_SPR_RETAINED_MAX - 1].link = link;
+        smd_spr_retained_dirty_add(SMD_SPR_RETAINED_MAX - 1);
+    }
+
+    /* Each run of contiguous changed slots goes in its own transfer */
+    dirty = smd_spr_retained_dirty;
+    while (dirty) {
+        while (!(dirty & 0x01)) {
+            dirty >>= 1;
+            ++first;
+        }
+        count = 0;
+        while (dirty & 0x01) {
+            dirty >>= 1;
+            ++count;
+        }
+        smd_dma_transfer_enqueue( &(smd_dma_transfer_t) {
+            .src  = &smd_spr_table[first],
+            .dest = SMD_VDP_SPRITE_TABLE_ADDR + (first << 3),
+            .size = count << 2,
+            .inc  = 2,
+            .type = SMD_DMA_VRAM_TRANSFER,
+            .priority = SMD_DMA_PRIORITY_CRITICAL
+        });
+        for (; count > 0; --count, ++first) {
+            other[first] = smd_spr_table[first];
+        }
+    }
+    smd_spr_retained_dirty = 0;
+#endif
+}
+
 void
 smd_spr_update(void) {
+    /*
+     * The other table is still queued until the DMA flush that executes its
+     * critical upload, filling it would tear the uploaded table, so the current
+     * sprites are dropped. Deferred commands of other modules don't hold it.
+     */
+    if (smd_spr_table_queued && !smd_dma_queue_sync_done(smd_spr_table_sync)) {
+        smd_kdebug_warning_if(true, "Previous table not flushed yet at smd_spr_update");
+        smd_spr_clear();
+        return;
+    }
+
+    smd_spr_retained_update();
     if (smd_spr_count > 0) {
-        smd_spr_table[smd_spr_count - 1].link = 0;
-    } else {
+        smd_spr_link_update();
+    } else if (SMD_SPR_RETAINED_MAX == 0) {
+        /* The first entry ends the chain */
         smd_spr_count = 1;
     }
 
     /* (smd_spr_count * sizeof(smd_spr_entry_t)) / 2  =  smd_spr_count << 2 because smd_spr_entry_t is 8 bytes */
-    smd_dma_transfer_fast( &(smd_dma_transfer_t) {
-        .src  = smd_spr_table,
-        .dest = SMD_VDP_SPRITE_TABLE_ADDR,
-        .size = smd_spr_count << 2,
-        .inc  = 2,
-        .type = SMD_DMA_VRAM_TRANSFER
-    });
+    if (smd_spr_count > 0) {
+        smd_dma_transfer_enqueue( &(smd_dma_transfer_t) {
+            .src  = &smd_spr_table[SMD_SPR_RETAINED_MAX],
+            .dest = SMD_VDP_SPRITE_TABLE_ADDR + (SMD_SPR_RETAINED_MAX << 3),
+            .size = smd_spr_count << 2,
+            .inc  = 2,
+            .type = SMD_DMA_VRAM_TRANSFER,
+            .priority = SMD_DMA_PRIORITY_CRITICAL
+        });
+    }
+
+    /* The queued table is kept until it is flushed, next sprites go to the other one */
+    smd_spr_table_sync = smd_dma_queue_sync_get();
+    smd_spr_table_queued = true;
+    smd_spr_table = (smd_spr_table == smd_spr_tables[0]) ? smd_spr_tables[1] : smd_spr_tables[0];
     smd_spr_clear();
 }
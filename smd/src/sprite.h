@@ -43,6 +43,69 @@ typedef enum {
     SMD_SPR_SIZE_4X4 = 0x0F
 } smd_spr_size_t;
 
+/**
+ * \brief           Default amount of retained sprite slots (32 at most)
+ * \note            Retained slots reduce the sprites available for immediate
+ *                  ones, so they are disabled by default.
+ */
+#ifndef SMD_SPR_RETAINED_MAX
+    #define SMD_SPR_RETAINED_MAX (0)
+#endif
+
+/**
+ * \brief           Shadow/highlight operators
+ *
+ * In shadow/highlight mode, sprite pixels using palette 3 colors 14 and 15 are
+ * not drawn, they highlight or shadow the pixels below them.
+ */
+typedef enum smd_spr_operator_t {
+    SMD_SPR_OPERATOR_HIGHLIGHT = 14,    /**< Palette 3 color 14 highlights */
+    SMD_SPR_OPERATOR_SHADOW    = 15     /**< Palette 3 color 15 shadows */
+} smd_spr_operator_t;
+
+/**
+ * \brief           Palette used by the shadow/highlight operator sprites
+ */
+#define SMD_SPR_OPERATOR_PALETTE (3)
+
+/**
+ * \brief           Metasprite piece, a hardware sprite inside a metasprite
+ */
+typedef struct smd_spr_meta_piece_t {
+    int8_t x;                   /**< Horizontal offset from the metasprite origin in pixels */
+    int8_t y;                   /**< Vertical offset from the metasprite origin in pixels */
+    uint16_t tile;              /**< Tile offset from the metasprite base tile index */
+    uint8_t size;               /**< Hardware sprite size (smd_spr_size_t) */
+} smd_spr_meta_piece_t;
+
+/**
+ * \brief           Metasprite frame, several hardware sprites drawn as one
+ *
+ * Frames are meant to be constant tables stored in ROM. Piece offsets are
+ * relative to the metasprite origin (i.e. the character feet), which is the
+ * axis used to mirror them on flipped metasprites.
+ */
+typedef struct smd_spr_meta_t {
+    const smd_spr_meta_piece_t *pieces; /**< Frame pieces, drawn in order */
+    uint8_t count;                      /**< Amount of pieces */
+} smd_spr_meta_t;
+
+/**
+ * \brief           Helper macro to define a metasprite piece
+ * \param[in]       px: Horizontal offset from the origin in pixels
+ * \param[in]       py: Vertical offset from the origin in pixels
+ * \param[in]       w: Width in tiles (1..4)
+ * \param[in]       h: Height in tiles (1..4)
+ * \param[in]       tile_offset: Tile offset from the metasprite base tile index
+ */
+#define SMD_SPR_META_PIECE(px, py, w, h, tile_offset)                       \
+    {                                                                       \
+        .x = (px),                                                          \
+        .y = (py),                                                          \
+        .tile = (tile_offset),                                              \
+        .size = SMD_SPR_SIZE_##w##X##h                                      \
+    }
+
 void smd_spr_init(void);
 
 uint16_t smd_spr_attributes_encode(const uint16_t priority, const uint16_t palette, const uint16_t v_flip,
@@ -58,6 +121,31 @@ void smd_spr_attributes_hflip(uint16_t *attributes);
 
 // smd_spr_attributes_index_set
 
+/**
+ * \brief           Build the attributes of a shadow/highlight operator sprite
+ * \param[in]       priority: Priority flag
+ * \param[in]       v_flip: Vertical flip flag
+ * \param[in]       h_flip: Horizontal flip flag
+ * \param[in]       tile_index: Operator tiles starting index in VRAM
+ * \return          Sprite attributes using the operators palette
+ */
+uint16_t smd_spr_operator_attributes_encode(const uint16_t priority, const uint16_t v_flip, const uint16_t h_flip,
+                                            const uint16_t tile_index);
+
+/**
+ * \brief           Fill tiles in VRAM with a shadow/highlight operator color
+ *
+ * Solid operator tiles let rectangular sprites work as light or darkness areas.
+ * Masked shapes (i.e. a round spotlight) need their own tiles drawn using the
+ * operator colors.
+ *
+ * \param[in]       tile_index: First tile index in VRAM
+ * \param[in]       count: Amount of tiles to fill
+ * \param[in]       op: Operator color used to fill the tiles
+ * \note            This function fills the tiles immediately using DMA
+ */
+void smd_spr_operator_tiles_fill(const uint16_t tile_index, const uint16_t count, const smd_spr_operator_t op);
+
 uint8_t smd_spr_size_encode(const uint8_t width, const uint8_t height);
 
 uint8_t smd_spr_size_to_tiles(const smd_spr_size_t size);
@@ -66,8 +154,128 @@ uint8_t smd_spr_size_to_tiles(const smd_spr_size_t size);
 // pasar params por pila
 void smd_spr_add(int16_t x, int16_t y, uint16_t attributes, uint8_t size);
 
+/**
+ * \brief           Add all the pieces of a metasprite frame
+ *
+ * Each piece is added as a hardware sprite using the metasprite attributes plus
+ * its tile offset. When the attributes have the horizontal or vertical flip
+ * flags, piece offsets are mirrored around the metasprite origin using the piece
+ * sizes. Pieces out of the screen are skipped.
+ *
+ * \param[in]       x: Metasprite origin horizontal screen position
+ * \param[in]       y: Metasprite origin vertical screen position
+ * \param[in]       attributes: Metasprite attributes with the base tile index
+ * \param[in]       meta: Metasprite frame to add
+ * \note            Pieces not fitting in the sprite table are dropped
+ */
+void smd_spr_meta_add(const int16_t x, const int16_t y, const uint16_t attributes,
+                      const smd_spr_meta_t *restrict meta);
+
 void smd_spr_clear(void);
 
+/**
+ * \brief           Set a retained sprite slot
+ *
+ * Immediate sprites (smd_spr_add, smd_spr_meta_add) must be added each frame.
+ * Retained slots keep their sprite across frames and are only uploaded by
+ * smd_spr_update when they change, which is useful for static sprites like HUD
+ * icons or idle props. They use the first sprite table entries and they are
+ * always first in the link chain, so they are drawn over immediate sprites.
+ * Unused slots are hidden.
+ *
+ * \param[in]       slot: Retained slot (0..SMD_SPR_RETAINED_MAX - 1)
+ * \param[in]       x: Horizontal screen position
+ * \param[in]       y: Vertical screen position
+ * \param[in]       attributes: Sprite attributes
+ * \param[in]       size: Sprite size (smd_spr_size_t)
+ * \note            Slots aren't clipped and keep their values if the display
+ *                  or interlace modes change, so set them again after that.
+ */
+void smd_spr_retained_set(const uint16_t slot, const int16_t x, int16_t y, uint16_t attributes,
+                          const uint8_t size);
+
+/**
+ * \brief           Move a retained sprite slot
+ * \param[in]       slot: Retained slot (0..SMD_SPR_RETAINED_MAX - 1)
+ * \param[in]       x: Horizontal screen position
+ * \param[in]       y: Vertical screen position
+ */
+void smd_spr_retained_move(const uint16_t slot, const int16_t x, int16_t y);
+
+/**
+ * \brief           Hide a retained sprite slot moving it out of the screen
+ * \param[in]       slot: Retained slot (0..SMD_SPR_RETAINED_MAX - 1)
+ */
+void smd_spr_retained_hide(const uint16_t slot);
+
+/**
+ * \brief           Enable or disable the sprites flicker mode
+ *
+ * The VDP drops sprites beyond its per line limits (20 sprites or 320 pixels in
+ * H40 mode, 16 sprites or 256 pixels in H32 mode), always the last ones in the
+ * sprite table link chain. In flicker mode, the sprites load of each 8 lines
+ * band is checked on smd_spr_update and, when a band goes over the limits, the
+ * link chain is rotated by the excess so a different set of sprites is dropped
+ * on each frame.
+ * Retained slots and the first immediate sprite in the link chain (the first
+ * added one, or the one with the highest key in sort mode) are always drawn
+ * first, so they never flicker.
+ *
+ * \param[in]       enabled: New flicker mode status
+ */
+void smd_spr_flicker_set(const bool enabled);
+
+/**
+ * \brief           Get the sprites flicker mode status
+ * \return          true if flicker mode is enabled, false otherwise
+ */
+bool smd_spr_flicker_get(void);
+
+/**
+ * \brief           Enable or disable the sprites depth sort mode
+ *
+ * The VDP draws the sprites following the sprite table link chain, the first
+ * ones over the next ones. By default the chain follows the order the sprites
+ * were added. In sort mode, each sprite carries a sort key and smd_spr_update
+ * links them by key using a radix sort, so sprites with higher keys are drawn
+ * over the ones with lower keys (i.e. using the feet y position as the key in
+ * a belt scroller). Sprites with the same key keep their adding order.
+ * Only the link fields are changed, except the first sorted sprite that is
+ * swapped with the first immediate sprite entry, where the chain goes after
+ * the retained slots.
+ *
+ * \param[in]       enabled: New sort mode status
+ */
+void smd_spr_sort_set(const bool enabled);
+
+/**
+ * \brief           Get the sprites depth sort mode status
+ * \return          true if sort mode is enabled, false otherwise
+ */
+bool smd_spr_sort_get(void);
+
+/**
+ * \brief           Set the sort key used by the next added sprites
+ * \param[in]       key: Sort key, higher keys are drawn over lower ones
+ * \note            Metasprites use the same key for all their pieces
+ */
+void smd_spr_key_set(const uint8_t key);
+
+/**
+ * \brief           Enqueue the sprite table in the DMA queue
+ *
+ * Sprite tables are double buffered. The finished table is enqueued as a
+ * critical transfer, so it is uploaded in order with the other queued
+ * transfers on the next flush, and new sprites are added to the other table.
+ * This lets the game build its sprites at any time during the frame.
+ *
+ * \note            Call it once per frame. The enqueued table is reused by the
+ *                  next call, so the queue must be flushed before that (in auto
+ *                  flush mode, swapped before the vertical blank). A call
+ *                  made before the flush carrying the previous table has ended
+ *                  (a missed or deferred flush) drops its sprites instead of
+ *                  tearing the queued table.
+ */
 void smd_spr_update(void);
 
 #ifdef __cplusplus
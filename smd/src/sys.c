@@ -15,10 +15,14 @@
 #include "mem_map.h"
 #include "handlers.h"
 #include "dma.h"
+#include "hud.h"
 #include "pad.h"
 #include "pal.h"
+#include "perf.h"
 #include "psg.h"
 #include "rand.h"
+#include "raster.h"
+#include "scroll.h"
 #include "sprite.h"
 #include "vdp.h"
 #include "xgm.h"
@@ -244,6 +248,8 @@ smd_sys_boot(void) {
         smd_xgm_init();
         /* Initialize the graphics  */
         smd_vdp_init();
+        /* Initialize the raster effects system */
+        smd_raster_init();
         /* Initialize the pseudo-random number generator */
         smd_rnd_init();
         /* Initialize the DMA system  */
@@ -252,6 +258,12 @@ smd_sys_boot(void) {
         smd_pal_init();
         /* Initialize the sprite system  */
         smd_spr_init();
+        /* Initialize the scroll system  */
+        smd_scroll_init();
+        /* Initialize the HUD system  */
+        smd_hud_init();
+        /* Initialize the CPU load meter  */
+        smd_perf_init();
     }
 
     /* Go play with it!! */
@@ -289,6 +301,19 @@ smd_sys_ints_status(void) {
     return smd_sys_ints_status_flag;
 }
 
+inline uint16_t
+smd_sys_ints_save(void) {
+    uint16_t sr;
+
+    __asm__ volatile("\tmove.w	%%sr, %0\n\tori.w	#0x700, %%sr\n" : "=d" (sr) : : "memory");
+    return sr;
+}
+
+inline void
+smd_sys_ints_restore(const uint16_t sr) {
+    __asm__ volatile("\tmove.w	%0, %%sr\n" : : "d" (sr) : "memory");
+}
+
 inline bool
 smd_sys_is_pal(void) {
     return *SMD_VERSION_PORT & SMD_VERSION_PORT_VMOD_FLAG;
@@ -167,6 +167,23 @@ void smd_sys_ints_disable(void);
  */
 bool smd_sys_ints_status(void);
 
+/**
+ * \brief           Mask all the interrupts keeping the previous mask
+ *
+ * Used around VDP port sequences which must not be split by the interrupt
+ * handlers, as they also use the VDP control port. It can be called from the
+ * interrupt handlers and it doesn't change the smd_sys_ints_status flag.
+ *
+ * \return          Previous status register value to use in smd_sys_ints_restore
+ */
+uint16_t smd_sys_ints_save(void);
+
+/**
+ * \brief           Restore the interrupts mask saved by smd_sys_ints_save
+ * \param[in]       sr: Status register value returned by smd_sys_ints_save
+ */
+void smd_sys_ints_restore(const uint16_t sr);
+
 /**
  * \brief           Check if the system is using PAL or NTSC video mode
  *
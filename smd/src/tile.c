@@ -13,17 +13,21 @@
 
 #include "tile.h"
 #include "dma.h"
+#include "vdp.h"
 
 inline void
 smd_tile_load(const smd_dma_transfer_ft dma_func, const void *restrict src, const uint16_t index, const uint16_t count){
+    /* 8x16 tiles in interlace mode 2 are twice the size */
+    const uint16_t shift = (smd_vdp_interlace_get() == SMD_VDP_INTERLACE_2) ? 5 : 4;
+
     /*
      * A real tile offset in VRAM is its index * 32 and the amount of words to
-     * transfer would be count (in tiles) * 16
+     * transfer would be count (in tiles) * 16 (or * 32 for 8x16 tiles)
      */
     dma_func(&(smd_dma_transfer_t){
         .src = (void *) src,
         .dest = index << 5,
-        .size = count << 4,
+        .size = count << shift,
         .inc = 2,
         .type = SMD_DMA_VRAM_TRANSFER
     });
@@ -49,8 +49,10 @@ extern "C" {
  *                      smd_dma_transfer_fast
  *                      smd_dma_transfer_enqueue
  * \param[in]       src: Source tiles address on RAM/ROM space
- * \param[in]       index: Destination tile index on VRAM
+ * \param[in]       index: Destination tile index on VRAM (in 8x8 tiles)
  * \param[in]       count: Amount of tiles to load to VRAM
+ * \note            In interlace mode 2 tiles are 8x16 pixels, so count is in
+ *                  8x16 tiles and index must be even.
  */
 void smd_tile_load(const smd_dma_transfer_ft dma_func, const void *restrict src, const uint16_t index, const uint16_t count);
 
@@ -12,16 +12,83 @@
  */
 
 #include "vdp.h"
+#include "dma.h"
+#include "kdebug.h"
 #include "mem_map.h"
+#include "perf.h"
+#include "raster.h"
+#include "sys.h"
 
 /**
  * \brief           Stores if the console is working in PAL mode
  */
 static uint8_t smd_vdp_smd_pal_mode_flag;
 
+/**
+ * \brief           Shadow copy of the VDP registers
+ */
+static uint8_t smd_vdp_regs[SMD_VDP_REG_COUNT];
+
+/**
+ * \brief           Registers changed in the shadow waiting to be written (one bit each)
+ */
+static volatile uint32_t smd_vdp_regs_dirty;
+
+/**
+ * \brief           Lines blanked at the top and bottom of the screen
+ */
+static uint8_t smd_vdp_blank_top;
+static uint8_t smd_vdp_blank_bottom;
+
+/**
+ * \brief           Horizontal interrupts received in the current frame
+ */
+static volatile uint8_t smd_vdp_blank_stage;
+
+/**
+ * \brief           Stores if the bottom blanked lines have started in this frame
+ */
+static volatile bool smd_vdp_blank_started;
+
+/**
+ * \brief           Planes A and B row and column shifts (log2 of their size in cells)
+ */
+static uint8_t smd_vdp_plane_width_shift;
+static uint8_t smd_vdp_plane_height_shift;
+
+/**
+ * \brief           Field drawn in the current frame on interlace modes
+ */
+static volatile uint8_t smd_vdp_field;
+
 /* This flag is set when the vertical blank starts */
 volatile uint8_t smd_vdp_vblank_flag;
 volatile uint8_t smd_int_counter = 0;
+
+/**
+ * \brief           Convert a plane size register field to a shift
+ * \param[in]       field: Plane size register width (bits 0-1) or height field
+ * \return          log2 of the plane size in cells (32, 64 or 128)
+ */
+static inline uint8_t
+smd_vdp_plane_size_shift(const uint8_t field) {
+    /* 00b: 32 cells, 01b: 64 cells, 11b: 128 cells */
+    return ((field & 0x03) == 0x03) ? 7 : (field & 0x03) + 5;
+}
+
+/**
+ * \brief           Check if two VRAM tables overlap
+ * \param[in]       a: First table address
+ * \param[in]       a_size: First table size in bytes
+ * \param[in]       b: Second table address
+ * \param[in]       b_size: Second table size in bytes
+ * \return          true if they overlap, false otherwise
+ */
+static inline bool
+smd_vdp_vram_tables_overlap(const uint32_t a, const uint32_t a_size, const uint32_t b, const uint32_t b_size) {
+    return (a < b + b_size) && (b < a + a_size);
+}
+
 void
 smd_vdp_init(void) {
     /*
@@ -31,38 +98,51 @@ smd_vdp_init(void) {
      */
     /* TODO: SI MULTIPLICO POR 8 (DESPLAZAR 3 A LA IZQ) PODRÍA QUITAR LOS TERNARIOS */
     smd_vdp_smd_pal_mode_flag = *SMD_VDP_CTRL_PORT_U16 & 0x01;
+    smd_vdp_blank_top = 0;
+    smd_vdp_blank_bottom = 0;
+    smd_vdp_blank_stage = 0;
+    smd_vdp_blank_started = false;
+    smd_vdp_field = 0;
 
-    /* Initialise the VDP register */
+    /* Initialise the VDP register and their shadow copy */
+    for (uint16_t i = 0; i < SMD_VDP_REG_COUNT; ++i) {
+        smd_vdp_regs[i] = 0x00;
+    }
+    smd_vdp_regs_dirty = 0;
     /* H interrupt off, HV counter on */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_1 | 0x04;
+    smd_vdp_reg_write(SMD_VDP_REG_MODESET_1, 0x04);
     /* Display off, V interrupt on, DMA on, V30 cells mode in pal, V28 ntsc  */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_2 | 0x34 | (smd_vdp_smd_pal_mode_flag ? 8 : 0);
+    smd_vdp_reg_write(SMD_VDP_REG_MODESET_2, 0x34 | (smd_vdp_smd_pal_mode_flag ? 8 : 0));
     /* Plane A table address (divided by 0x2000 and lshifted 3 = rshift 10 ) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_PLANEA_ADDR | (SMD_VDP_PLANE_A_ADDR >> 10);
+    smd_vdp_reg_write(SMD_VDP_REG_PLANEA_ADDR, SMD_VDP_PLANE_A_ADDR >> 10);
     /* Plane W table address (divided by 0x800 and lshifted 1 = rsifht 10) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_WINDOW_ADDR | (SMD_VDP_PLANE_W_ADDR >> 10);
+    smd_vdp_reg_write(SMD_VDP_REG_WINDOW_ADDR, SMD_VDP_PLANE_W_ADDR >> 10);
     /* Plane B table address (divided by 0x2000 = rsifht 13) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_PLANEB_ADDR | (SMD_VDP_PLANE_B_ADDR >> 13);
+    smd_vdp_reg_write(SMD_VDP_REG_PLANEB_ADDR, SMD_VDP_PLANE_B_ADDR >> 13);
     /* Sprite table address (divided by 0x200 = rsifht 9) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_SPRITE_ADDR | (SMD_VDP_SPRITE_TABLE_ADDR >> 9);
+    smd_vdp_reg_write(SMD_VDP_REG_SPRITE_ADDR, SMD_VDP_SPRITE_TABLE_ADDR >> 9);
     /* Background color: palette 0, color 0 */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_BGCOLOR | 0x00;
+    smd_vdp_reg_write(SMD_VDP_REG_BGCOLOR, 0x00);
     /* H interrupt frequency in raster lines (As we disabled it, set maximum) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_HBLANK_RATE | 0xFF;
+    smd_vdp_reg_write(SMD_VDP_REG_HBLANK_RATE, 0xFF);
     /* External interrupt off, V scroll, H scroll */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_3 | SMD_VDP_VSCROLL_MODE | SMD_VDP_HSCROLL_MODE;
+    smd_vdp_reg_write(SMD_VDP_REG_MODESET_3, SMD_VDP_VSCROLL_MODE | SMD_VDP_HSCROLL_MODE);
     /* H40 cells mode, shadows and highlights off, interlace mode off */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_4 | 0x81;
+    smd_vdp_reg_write(SMD_VDP_REG_MODESET_4, 0x81);
     /* H Scroll table address (divided by 0x400 = rsifht 10) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_HSCROLL_ADDR | (SMD_VDP_HSCROLL_TABLE_ADDR >> 10);
+    smd_vdp_reg_write(SMD_VDP_REG_HSCROLL_ADDR, SMD_VDP_HSCROLL_TABLE_ADDR >> 10);
     /* Auto increment in bytes for the VDP's address reg after read or write */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_AUTOINC | 0x02;
+    smd_vdp_reg_write(SMD_VDP_REG_AUTOINC, 0x02);
     /* Scroll size (planes A and B size) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_PLANE_SIZE | SMD_VDP_PLANE_SIZE;
+    smd_vdp_reg_write(SMD_VDP_REG_PLANE_SIZE, SMD_VDP_PLANE_SIZE);
+    smd_vdp_plane_width_shift = smd_vdp_plane_size_shift(SMD_VDP_PLANE_SIZE);
+    smd_vdp_plane_height_shift = smd_vdp_plane_size_shift(SMD_VDP_PLANE_SIZE >> 4);
     /* Window plane X position (no window) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_WINDOW_XPOS | 0x00;
+    smd_vdp_reg_write(SMD_VDP_REG_WINDOW_XPOS, 0x00);
     /* Window plane Y position (no window) */
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_WINDOW_YPOS | 0x00;
+    smd_vdp_reg_write(SMD_VDP_REG_WINDOW_YPOS, 0x00);
+
+    smd_kdebug_warning_if(!smd_vdp_vram_layout_check(SMD_VDP_PLANE_SIZE), "VRAM tables overlap at smd_vdp_init");
 
     /* Clean the VDP's rams */
     smd_vdp_vram_clear();
@@ -70,69 +150,355 @@ smd_vdp_init(void) {
     smd_vdp_vsram_clear();
 }
 
+inline void
+smd_vdp_reg_write(const uint16_t reg, const uint8_t value) {
+    const uint8_t index = (reg >> 8) & 0x1F;
+
+    smd_vdp_regs[index] = value;
+    smd_vdp_regs_dirty &= ~(1UL << index);
+    *SMD_VDP_CTRL_PORT_U16 = reg | value;
+}
+
+inline void
+smd_vdp_reg_set(const uint16_t reg, const uint8_t value) {
+    const uint8_t index = (reg >> 8) & 0x1F;
+
+    /* A pending deferred write must be done even if the value is the same */
+    if (smd_vdp_regs[index] != value || (smd_vdp_regs_dirty & (1UL << index))) {
+        smd_vdp_reg_write(reg, value);
+    }
+}
+
+inline void
+smd_vdp_reg_defer(const uint16_t reg, const uint8_t value) {
+    const uint8_t index = (reg >> 8) & 0x1F;
+
+    if (smd_vdp_regs[index] != value) {
+        smd_vdp_regs[index] = value;
+        smd_vdp_regs_dirty |= 1UL << index;
+    }
+}
+
+inline uint8_t
+smd_vdp_reg_get(const uint16_t reg) {
+    return smd_vdp_regs[(reg >> 8) & 0x1F];
+}
+
+inline void
+smd_vdp_reg_sync(const uint16_t reg_cmd) {
+    smd_vdp_regs[(reg_cmd >> 8) & 0x1F] = reg_cmd & 0xFF;
+}
+
+void
+smd_vdp_reg_flush(void) {
+    uint32_t dirty = smd_vdp_regs_dirty;
+
+    smd_vdp_regs_dirty = 0;
+    for (uint16_t i = 0; dirty; ++i, dirty >>= 1) {
+        if (dirty & 0x01) {
+            *SMD_VDP_CTRL_PORT_U16 = 0x8000 | (i << 8) | smd_vdp_regs[i];
+        }
+    }
+}
+
+void
+smd_vdp_mode_set(const smd_vdp_hmode_t hmode, const smd_vdp_vmode_t vmode) {
+    /* NTSC systems can't display V30 */
+    const uint8_t v30 = smd_vdp_smd_pal_mode_flag ? vmode : SMD_VDP_V28;
+
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_4, (smd_vdp_regs[12] & ~0x81) | hmode);
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_2, (smd_vdp_regs[1] & ~0x08) | v30);
+    smd_dma_budget_reset();
+}
+
+inline uint16_t
+smd_vdp_screen_width_get(void) {
+    return (smd_vdp_regs[12] & 0x01) ? 320 : 256;
+}
+
+inline uint16_t
+smd_vdp_screen_height_get(void) {
+    return (smd_vdp_regs[1] & 0x08) ? 240 : 224;
+}
+
+inline bool
+smd_vdp_is_h40(void) {
+    return smd_vdp_regs[12] & 0x01;
+}
+
+inline uint16_t
+smd_vdp_sprite_max_get(void) {
+    return (smd_vdp_regs[12] & 0x01) ? 80 : 64;
+}
+
+inline uint16_t
+smd_vdp_window_width_shift_get(void) {
+    /* The window plane is 64 cells wide in H40 mode and 32 in H32 */
+    return (smd_vdp_regs[12] & 0x01) ? 6 : 5;
+}
+
 inline void
 smd_vdp_display_enable(void) {
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_2 | 0x74 | (smd_vdp_smd_pal_mode_flag ? 8 : 0);
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_2, smd_vdp_regs[1] | 0x40);
 }
 
 inline void
 smd_vdp_display_disable(void) {
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_2 | 0x34 | (smd_vdp_smd_pal_mode_flag ? 8 : 0);
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_2, smd_vdp_regs[1] & ~0x40);
+}
+
+void
+smd_vdp_blank_lines_set(const uint8_t top, const uint8_t bottom) {
+    const uint16_t active = smd_vdp_screen_height_get();
+
+    if (top + bottom != 0 && active <= (top << 1) + bottom) {
+        smd_kdebug_warning_if(true, "Too many blanked lines at smd_vdp_blank_lines_set");
+        return;
+    }
+    smd_kdebug_warning_if(top + bottom != 0 && smd_raster_is_enabled(), "Raster effects running at smd_vdp_blank_lines_set");
+    if (top + bottom != 0 && smd_raster_is_enabled()) {
+        return;
+    }
+    smd_vdp_blank_top = top;
+    smd_vdp_blank_bottom = bottom;
+    smd_vdp_blank_stage = 0;
+    smd_vdp_blank_started = false;
+    if (smd_raster_is_enabled()) {
+        /* Raster effects own the H interrupt */
+    } else if (top + bottom == 0) {
+        /* H interrupt off */
+        smd_vdp_reg_set(SMD_VDP_REG_HBLANK_RATE, 0xFF);
+        smd_vdp_reg_set(SMD_VDP_REG_MODESET_1, smd_vdp_regs[0] & ~0x10);
+    } else {
+        /* H interrupt on. The rate is set in each vblank */
+        smd_vdp_reg_set(SMD_VDP_REG_MODESET_1, smd_vdp_regs[0] | 0x10);
+    }
+    smd_dma_budget_reset();
+}
+
+inline uint16_t
+smd_vdp_blank_lines_get(void) {
+    return smd_vdp_blank_top + smd_vdp_blank_bottom;
+}
+
+bool
+smd_vdp_blank_vint_update(void) {
+    const uint16_t active = smd_vdp_screen_height_get();
+    const bool started = smd_vdp_blank_started;
+
+    smd_vdp_blank_stage = 0;
+    smd_vdp_blank_started = false;
+    if (!(smd_vdp_regs[1] & 0x40) || (smd_vdp_blank_top | smd_vdp_blank_bottom) == 0) {
+        return true;
+    }
+
+    /*
+     * The H-int counter is reloaded on each vblank line, so the rate written
+     * here is used for the first interrupt of the next frame.
+     */
+    if (smd_vdp_blank_top) {
+        /* Not using the shadow, it keeps the display state set by the game */
+        *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_2 | (smd_vdp_regs[1] & ~0x40);
+        smd_vdp_reg_set(SMD_VDP_REG_HBLANK_RATE, smd_vdp_blank_top - 1);
+    } else {
+        /* Turned off by the H-int on the bottom lines of the previous frame */
+        *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_2 | smd_vdp_regs[1];
+        smd_vdp_reg_set(SMD_VDP_REG_HBLANK_RATE, active - smd_vdp_blank_bottom - 1);
+    }
+    return !started;
+}
+
+bool
+smd_vdp_blank_hint_update(void) {
+    const uint16_t active = smd_vdp_screen_height_get();
+    const uint8_t stage = smd_vdp_blank_stage++;
+
+    if (!(smd_vdp_regs[1] & 0x40)) {
+        return false;
+    }
+    if (smd_vdp_blank_top && stage == 0) {
+        *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_2 | smd_vdp_regs[1];
+        /*
+         * A new rate is used after the next interrupt, which still comes with
+         * the top rate. The bottom lines start at the third interrupt.
+         */
+        if (smd_vdp_blank_bottom) {
+            smd_vdp_reg_set(SMD_VDP_REG_HBLANK_RATE, active - smd_vdp_blank_bottom - (smd_vdp_blank_top << 1) - 1);
+        } else {
+            smd_vdp_reg_set(SMD_VDP_REG_HBLANK_RATE, 0xFF);
+        }
+        return false;
+    }
+    if (smd_vdp_blank_bottom && stage == (smd_vdp_blank_top ? 2 : 0)) {
+        *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_2 | (smd_vdp_regs[1] & ~0x40);
+        smd_vdp_reg_set(SMD_VDP_REG_HBLANK_RATE, 0xFF);
+        smd_vdp_blank_started = true;
+        return true;
+    }
+    return false;
 }
 
 void
 smd_vdp_vsync_wait(void) {
+    uint16_t idle = 0;
+
+    smd_perf_frame_end();
     /* Set the vblak flag to 0 and wait for the vblank interrupt to change it */
     smd_vdp_vblank_flag = 0;
     while (!smd_vdp_vblank_flag) {
         __asm__ volatile("\tnop\n");
+        ++idle;
     }
     smd_vdp_vblank_flag = 0;
+    smd_perf_frame_start(idle);
 }
 
 void
 smd_vdp_vram_clear(void) {
-    *SMD_VDP_CTRL_PORT_U32 = SMD_VDP_VRAM_WRITE_CMD;
+    /* An interrupt using the VDP would change the write address */
+    const uint16_t sr = smd_sys_ints_save();
 
+    *SMD_VDP_CTRL_PORT_U32 = SMD_VDP_VRAM_WRITE_CMD;
     for (uint16_t i = 0; i < (65536 / 4); ++i) {
         *SMD_VDP_DATA_PORT_U32 = 0x00;
     }
+    smd_sys_ints_restore(sr);
 }
 
 void
 smd_vdp_cram_clear(void) {
-    *SMD_VDP_CTRL_PORT_U32 = SMD_VDP_CRAM_WRITE_CMD;
+    /* An interrupt using the VDP would change the write address */
+    const uint16_t sr = smd_sys_ints_save();
 
+    *SMD_VDP_CTRL_PORT_U32 = SMD_VDP_CRAM_WRITE_CMD;
     for (uint16_t i = 0; i < (128 / 4); ++i) {
         *SMD_VDP_DATA_PORT_U32 = 0;
     }
+    smd_sys_ints_restore(sr);
 }
 
 void
 smd_vdp_vsram_clear(void) {
-    *SMD_VDP_CTRL_PORT_U32 = SMD_VDP_VSRAM_WRITE_CMD;
+    /* An interrupt using the VDP would change the write address */
+    const uint16_t sr = smd_sys_ints_save();
 
+    *SMD_VDP_CTRL_PORT_U32 = SMD_VDP_VSRAM_WRITE_CMD;
     for (uint16_t i = 0; i < (80 / 4); ++i) {
         *SMD_VDP_DATA_PORT_U32 = 0;
     }
+    smd_sys_ints_restore(sr);
 }
 
 inline void
 smd_vdp_background_color_set(const uint8_t index) {
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_BGCOLOR | index;
+    smd_vdp_reg_set(SMD_VDP_REG_BGCOLOR, index);
 }
 
 inline void
 smd_vdp_scroll_mode_set(const smd_vdp_hscroll_mode_t hscroll_mode, const smd_vdp_vscroll_mode_t vscroll_mode) {
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_MODESET_3 | vscroll_mode | hscroll_mode;
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_3, (smd_vdp_regs[11] & ~0x07) | vscroll_mode | hscroll_mode);
 }
 
-inline void
+bool
 smd_vdp_plane_size_set(const smd_vdp_plane_size_t size) {
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_PLANE_SIZE | size;
+    if (!smd_vdp_vram_layout_check(size)) {
+        smd_kdebug_warning_if(true, "VRAM tables overlap at smd_vdp_plane_size_set");
+        return false;
+    }
+    smd_vdp_reg_set(SMD_VDP_REG_PLANE_SIZE, size);
+    smd_vdp_plane_width_shift = smd_vdp_plane_size_shift(size);
+    smd_vdp_plane_height_shift = smd_vdp_plane_size_shift(size >> 4);
+    return true;
+}
+
+inline uint16_t
+smd_vdp_plane_width_shift_get(void) {
+    return smd_vdp_plane_width_shift;
+}
+
+inline uint16_t
+smd_vdp_plane_height_shift_get(void) {
+    return smd_vdp_plane_height_shift;
+}
+
+inline uint16_t
+smd_vdp_plane_width_get(void) {
+    return 1 << smd_vdp_plane_width_shift;
+}
+
+inline uint16_t
+smd_vdp_plane_height_get(void) {
+    return 1 << smd_vdp_plane_height_shift;
+}
+
+bool
+smd_vdp_vram_layout_check(const smd_vdp_plane_size_t size) {
+    const uint32_t plane_bytes = 2UL << (smd_vdp_plane_size_shift(size) + smd_vdp_plane_size_shift(size >> 4));
+    /*
+     * Window plane is 32 cells high and its width depends on the H32/H40 mode.
+     * Layouts sharing it with plane A can't use the window.
+     */
+    const uint32_t window_bytes = (SMD_VDP_PLANE_W_ADDR == SMD_VDP_PLANE_A_ADDR)
+                                  ? 0 : 64UL << smd_vdp_window_width_shift_get();
+    const uint32_t sprite_bytes = smd_vdp_sprite_max_get() << 3;
+    /* Line scroll mode uses 4 bytes per line */
+    const uint32_t hscroll_bytes = 240 * 4;
+    const uint32_t addrs[5] = {SMD_VDP_PLANE_A_ADDR, SMD_VDP_PLANE_B_ADDR, SMD_VDP_PLANE_W_ADDR,
+                               SMD_VDP_SPRITE_TABLE_ADDR, SMD_VDP_HSCROLL_TABLE_ADDR};
+    const uint32_t sizes[5] = {plane_bytes, plane_bytes, window_bytes, sprite_bytes, hscroll_bytes};
+    /* Address bits ignored by each table base register */
+    const uint32_t masks[5] = {0x1FFF, 0x1FFF, (64UL << smd_vdp_window_width_shift_get()) - 1,
+                               (sprite_bytes > 512) ? 0x3FF : 0x1FF, 0x3FF};
+
+    for (uint16_t i = 0; i < 5; ++i) {
+        if ((addrs[i] & masks[i]) || addrs[i] + sizes[i] > 0x10000) {
+            return false;
+        }
+        for (uint16_t j = i + 1; j < 5; ++j) {
+            if (smd_vdp_vram_tables_overlap(addrs[i], sizes[i], addrs[j], sizes[j])) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
 inline void
 smd_vdp_autoinc_set(const uint8_t increment) {
-    *SMD_VDP_CTRL_PORT_U16 = SMD_VDP_REG_AUTOINC | increment;
+    smd_vdp_reg_set(SMD_VDP_REG_AUTOINC, increment);
+}
+
+inline void
+smd_vdp_hilightshadow_set(const bool enabled) {
+    const uint8_t mode = smd_vdp_regs[12];
+
+    smd_vdp_reg_set(SMD_VDP_REG_MODESET_4, enabled ? (mode | 0x08) : (mode & ~0x08));
+}
+
+inline bool
+smd_vdp_hilightshadow_get(void) {
+    return smd_vdp_regs[12] & 0x08;
+}
+
+inline void
+smd_vdp_interlace_set(const smd_vdp_interlace_t mode) {
+    smd_vdp_reg_defer(SMD_VDP_REG_MODESET_4, (smd_vdp_regs[12] & ~0x06) | mode);
+}
+
+inline smd_vdp_interlace_t
+smd_vdp_interlace_get(void) {
+    return smd_vdp_regs[12] & 0x06;
+}
+
+inline uint8_t
+smd_vdp_field_get(void) {
+    return smd_vdp_field;
+}
+
+inline void
+smd_vdp_field_update(void) {
+    /* Status register bit 4 is set while the odd field is drawn */
+    if (smd_vdp_regs[12] & 0x02) {
+        smd_vdp_field = (*SMD_VDP_CTRL_PORT_U16 >> 4) & 0x01;
+    }
 }
@@ -62,6 +62,12 @@ extern "C" {
 #define SMD_VDP_REG_DMASRC_L        (0x9500) /* DMA source (low) */
 #define SMD_VDP_REG_DMASRC_M        (0x9600) /* DMA source (mid) */
 #define SMD_VDP_REG_DMASRC_H        (0x9700) /* DMA source (high) */
+
+/**
+ * \brief           Amount of VDP registers
+ */
+#define SMD_VDP_REG_COUNT           (24)
+
 /**
  * \brief           Extended KMod VDP registers.
  *
@@ -86,20 +92,46 @@ extern "C" {
 #define SMD_VDP_DMA_CRAM_WRITE_CMD  (0xC0000080)
 #define SMD_VDP_DMA_VSRAM_WRITE_CMD (0x40000090)
 
+/**
+ * \brief           Base command for the control port to do DMA copies inside VRAM
+ */
+#define SMD_VDP_DMA_VRAM_COPY_CMD   (0x000000C0)
+
 /*
  * Default VDP memory layout
  *  #0000..#BFFF - 1536 tiles
  *  #C000..#CFFF - Plane A (64x32, 4096 Bytes)
- *  #D000..#D000 - Plane W (0x0)
- *  #D000..#DFFF - 128 tiles
+ *  #D000..#DFFF - Plane W (64x32 in H40, 4096 Bytes) or 128 tiles while the
+ *                 window is not used (no HUD region set, see hud.h)
  *  #E000..#EFFF - Plane B (64x32, 4096 Bytes)
  *  #F000..#F7FF - 64 Tiles
  *  #F800..#FBBF - HScroll table (960 Bytes)
  *  #FBC0..#FBFF - 2 tiles
  *  #FC00..#FE7F - Sprite table (640 Bytes)
  *  #FE80..#FFFF - 12 tiles
- *  -> 1742 free tiles
+ *  -> 1742 free tiles, 1614 while the window is used
+ *
+ * Interlace mode 2 VRAM layout (SMD_VDP_LAYOUT_INTERLACE_2 defined)
+ *  #0000..#BFFF - 1536 tiles (768 8x16 tiles)
+ *  #C000..#CFFF - Plane A (64x32, 4096 Bytes)
+ *  #C000..#C000 - Plane W, shares plane A so the window can't be used
+ *  #D000..#DFFF - 128 tiles (64 8x16 tiles), starting at tile index 1664
+ *  #E000..#FFFF - Plane B, HScroll and sprite tables, as in the default layout
+ *
+ * This layout doesn't add tile space: the tiles are the same as in the default
+ * layout, it only moves plane W onto plane A. It trades away the window (and
+ * the HUD) to keep #D000..#DFFF always free for tiles, as the default layout
+ * uses that room for the window name table.
+ * Planes A and B must start on 8kB boundaries (plane A can't go after #C000 as
+ * plane B uses #E000), so the VRAM arena keeps the first 1536 tiles and the
+ * #D000 tiles stay as a separate block out of the arena.
  */
+#ifdef SMD_VDP_LAYOUT_INTERLACE_2
+    #ifndef SMD_VDP_PLANE_W_ADDR
+        #define SMD_VDP_PLANE_W_ADDR (0xC000)
+    #endif
+#endif
+
 /**
  * \brief           Default planes start address in VRAM
  */
@@ -171,6 +203,46 @@ typedef enum smd_vdp_plane_size_t {
     SMD_VDP_PLANE_SIZE_128X32   = 0x03
 } smd_vdp_plane_size_t;
 
+/**
+ * \brief           VDP horizontal resolution modes
+ */
+typedef enum smd_vdp_hmode_t {
+    SMD_VDP_H32 = 0x00,         /**< 256 pixels (32 cells) wide, 64 sprites */
+    SMD_VDP_H40 = 0x81          /**< 320 pixels (40 cells) wide, 80 sprites */
+} smd_vdp_hmode_t;
+
+/**
+ * \brief           VDP vertical resolution modes
+ */
+typedef enum smd_vdp_vmode_t {
+    SMD_VDP_V28 = 0x00,         /**< 224 pixels (28 cells) high */
+    SMD_VDP_V30 = 0x08          /**< 240 pixels (30 cells) high, only on PAL systems */
+} smd_vdp_vmode_t;
+
+/**
+ * \brief           VDP interlace modes
+ *
+ * Interlace mode 2 doubles the vertical resolution drawing even and odd lines
+ * in alternate fields (frames). Tiles become 8x16 pixels (64 bytes), so tile
+ * indexes in plane cells and sprites count 8x16 tiles. This library keeps VRAM
+ * tile indexes in 8x8 tile units (32 bytes) everywhere (tile loading, vram
+ * arena) and translates them when building cells and sprites, so 8x16 tiles
+ * must start at even indexes.
+ * The DMA bandwidth per field doesn't change, but tiles are twice the size, so
+ * each vertical blank moves half the tiles it moves in the other modes, and a
+ * full 40x28 cells screen of unique 8x16 tiles (71680 bytes) doesn't fit in
+ * VRAM. No DMA cost per field has been measured on hardware for this mode, the
+ * bytes actually moved on each field can be read from the flushed_bytes field
+ * of smd_dma_stats_get.
+ * Define SMD_VDP_LAYOUT_INTERLACE_2 to give up the window and keep the #D000
+ * tiles free (see the VRAM layouts above).
+ */
+typedef enum smd_vdp_interlace_t {
+    SMD_VDP_INTERLACE_OFF   = 0x00, /**< No interlace */
+    SMD_VDP_INTERLACE_1     = 0x02, /**< Interlace, same image in both fields */
+    SMD_VDP_INTERLACE_2     = 0x06  /**< Interlace with double vertical resolution */
+} smd_vdp_interlace_t;
+
 /*
  * CHECKME: QUIZÁ PODRÍAMOS TENER UN struct smd_context.vblank_flag o similar
  * CHECKME: No habría otra manera de gestionar este flag en lugar de una global?
@@ -193,6 +265,105 @@ extern volatile uint8_t smd_int_counter;
  */
 void smd_vdp_init(void);
 
+/**
+ * \brief           Write a VDP register and update its shadow copy
+ *
+ * The VDP registers are write only, so a shadow copy of them is kept in ram.
+ * This lets the game read them and skip writes that don't change anything.
+ *
+ * \param[in]       reg: Register to write (SMD_VDP_REG_*)
+ * \param[in]       value: Register value
+ * \note            This function always writes the register, see smd_vdp_reg_set
+ */
+void smd_vdp_reg_write(const uint16_t reg, const uint8_t value);
+
+/**
+ * \brief           Write a VDP register only if its value changes
+ * \param[in]       reg: Register to write (SMD_VDP_REG_*)
+ * \param[in]       value: Register value
+ */
+void smd_vdp_reg_set(const uint16_t reg, const uint8_t value);
+
+/**
+ * \brief           Change a VDP register in the next vertical blank
+ *
+ * The shadow copy is updated now and the register is written on the next
+ * vertical blank with the rest of the deferred registers, so changes made along
+ * the frame don't tear the display.
+ *
+ * \param[in]       reg: Register to write (SMD_VDP_REG_*)
+ * \param[in]       value: Register value
+ */
+void smd_vdp_reg_defer(const uint16_t reg, const uint8_t value);
+
+/**
+ * \brief           Get the value of a VDP register from its shadow copy
+ * \param[in]       reg: Register to read (SMD_VDP_REG_*)
+ * \return          Last value set to the register
+ * \note            DMA length and source registers are changed by the VDP
+ *                  itself, their values are just the last ones set.
+ */
+uint8_t smd_vdp_reg_get(const uint16_t reg);
+
+/**
+ * \brief           Update a register shadow copy after a write done outside this module
+ * \param[in]       reg_cmd: Register write command already sent (SMD_VDP_REG_* | value)
+ * \note            Used by the DMA queue, which issues its commands directly
+ */
+void smd_vdp_reg_sync(const uint16_t reg_cmd);
+
+/**
+ * \brief           Write the deferred VDP registers
+ * \note            Called from the vertical blank interrupt handler
+ */
+void smd_vdp_reg_flush(void);
+
+/**
+ * \brief           Set the display resolution
+ *
+ * Screen geometry is runtime state used by the rest of the library: sprite
+ * clipping and limit, window plane addressing, HUD regions, display lines
+ * blanking and the DMA queue budget (H32 has less DMA bandwidth per line).
+ *
+ * \param[in]       hmode: Horizontal resolution
+ * \param[in]       vmode: Vertical resolution. V30 is turned into V28 on NTSC
+ *                  systems as they can't display it
+ * \note            The registers are changed immediately, so use it with the
+ *                  display off or in the vertical blank. The HUD region and the
+ *                  display lines blanking should be set again after it.
+ */
+void smd_vdp_mode_set(const smd_vdp_hmode_t hmode, const smd_vdp_vmode_t vmode);
+
+/**
+ * \brief           Get the screen width
+ * \return          Screen width in pixels (256 or 320)
+ */
+uint16_t smd_vdp_screen_width_get(void);
+
+/**
+ * \brief           Get the screen height
+ * \return          Screen height in pixels (224 or 240)
+ */
+uint16_t smd_vdp_screen_height_get(void);
+
+/**
+ * \brief           Get if the horizontal resolution is H40
+ * \return          true in H40 mode, false in H32 mode
+ */
+bool smd_vdp_is_h40(void);
+
+/**
+ * \brief           Get the maximum amount of sprites in the current mode
+ * \return          80 in H40 mode, 64 in H32 mode
+ */
+uint16_t smd_vdp_sprite_max_get(void);
+
+/**
+ * \brief           Get the window plane row shift
+ * \return          log2 of the window plane width in cells (6 in H40, 5 in H32)
+ */
+uint16_t smd_vdp_window_width_shift_get(void);
+
 /**
  * \brief           Turn on the display
  */
@@ -203,6 +374,49 @@ void smd_vdp_display_enable(void);
  */
 void smd_vdp_display_disable(void);
 
+/**
+ * \brief           Blank lines at the top and bottom of the screen to extend the DMA window
+ *
+ * DMA during active display is much slower than in vertical blank. Turning the
+ * display off for some lines around the vertical blank (letterboxing) makes
+ * the whole DMA speed window bigger. Top lines are turned off from the vertical
+ * blank interrupt and turned on again from the horizontal one. Bottom lines are
+ * turned off from the horizontal interrupt, which also flushes the DMA queue
+ * in auto flush mode so they can be used for transfers.
+ * The DMA queue budget is updated to include the blanked lines in auto flush
+ * mode, the only one where the queue is flushed while they are blanked.
+ * Lines blanking and raster effects can't be used at the same time, both use
+ * the horizontal interrupt.
+ *
+ * \param[in]       top: Lines to blank at the top of the screen
+ * \param[in]       bottom: Lines to blank at the bottom of the screen
+ * \note            Use 0 lines on both to disable it. The horizontal interrupt
+ *                  is enabled while lines are blanked. Because of how the H-int
+ *                  counter reloads, the visible area must be taller than top * 2.
+ */
+void smd_vdp_blank_lines_set(const uint8_t top, const uint8_t bottom);
+
+/**
+ * \brief           Get the amount of blanked lines at the top and bottom of the screen
+ * \return          Total blanked lines
+ */
+uint16_t smd_vdp_blank_lines_get(void);
+
+/**
+ * \brief           Update the lines blanking on the vertical blank interrupt
+ * \return          true if the DMA queue must be flushed here, false if it was
+ *                  already flushed from the bottom blanked lines
+ * \note            Called from the vertical blank interrupt handler
+ */
+bool smd_vdp_blank_vint_update(void);
+
+/**
+ * \brief           Update the lines blanking on the horizontal blank interrupt
+ * \return          true if the bottom blanked lines just started
+ * \note            Called from the horizontal blank interrupt handler
+ */
+bool smd_vdp_blank_hint_update(void);
+
 /**
  * \brief           Waits until the next vertical blank starts
  * \note            Be aware that this will loop forever if interrupts are disabled
@@ -238,9 +452,62 @@ void smd_vdp_scroll_mode_set(const smd_vdp_hscroll_mode_t hscroll_mode, const sm
 
 /**
  * \brief           Set plane size for planes A and B
+ *
+ * Planes size is runtime state with precomputed row and column shifts, so plane
+ * addressing doesn't need multiplications.
+ * The default VRAM layout only has room for 4kB planes (32x32, 32x64 and
+ * 64x32). 8kB planes (64x64, 128x32 and 32x128) are always rejected unless the
+ * SMD_VDP_*_ADDR macros are overridden at build time with a layout that fits
+ * them, i.e. plane B at #A000, plane A at #C000 and plane W at #E000, with
+ * SMD_VRAM_ARENA_SIZE reduced to 1280 tiles.
+ *
  * \param           size: New plane size
+ * \return          true on success, false if the planes with the new size would
+ *                  overlap other VRAM tables (see smd_vdp_vram_layout_check)
+ */
+bool smd_vdp_plane_size_set(const smd_vdp_plane_size_t size);
+
+/**
+ * \brief           Get the planes A and B row shift
+ * \return          log2 of the planes width in cells
+ */
+uint16_t smd_vdp_plane_width_shift_get(void);
+
+/**
+ * \brief           Get the planes A and B column shift
+ * \return          log2 of the planes height in cells
+ */
+uint16_t smd_vdp_plane_height_shift_get(void);
+
+/**
+ * \brief           Get the planes A and B width
+ * \return          Planes width in cells (32, 64 or 128)
+ */
+uint16_t smd_vdp_plane_width_get(void);
+
+/**
+ * \brief           Get the planes A and B height
+ * \return          Planes height in cells (32, 64 or 128)
  */
-void smd_vdp_plane_size_set(const smd_vdp_plane_size_t size);
+uint16_t smd_vdp_plane_height_get(void);
+
+/**
+ * \brief           Check the VRAM tables layout with a planes size
+ *
+ * Planes A, B and W, the sprite table and the horizontal scroll table are
+ * placed at the SMD_VDP_*_ADDR addresses. Bigger planes need more room, so the
+ * layout must leave enough space after planes A and B (i.e. 64x64 planes use
+ * 8kB each).
+ * Each table must also start at the boundary its VDP register can address:
+ * 8kB for planes A and B, 4kB for the window in H40 mode (2kB in H32), 1kB for
+ * the sprite table in H40 mode (512 bytes in H32) and 1kB for the horizontal
+ * scroll table. A window sharing plane A is allowed, but can't be used.
+ *
+ * \param           size: Planes size to check
+ * \return          true if the tables are aligned and don't overlap, false
+ *                  otherwise
+ */
+bool smd_vdp_vram_layout_check(const smd_vdp_plane_size_t size);
 
 /**
  * \brief           Set the number of bytes to add automatically after read/write operations
@@ -252,11 +519,49 @@ void smd_vdp_plane_size_set(const smd_vdp_plane_size_t size);
  */
 void smd_vdp_autoinc_set(const uint8_t increment);
 
-/*
-    * TODO:
-    smd_vdp_hilightshadow_set
+/**
+ * \brief           Turn on or off the shadow/highlight mode
+ *
+ * In shadow/highlight mode, low priority plane cells are drawn shadowed (half
+ * brightness) and high priority ones normally. Sprites with palette 3 colors 14
+ * and 15 work as operators, highlighting or shadowing what is below them instead
+ * of being drawn (see smd_spr_operator_*).
+ *
+ * \param           enabled: true to turn on the mode, false to turn it off
+ */
+void smd_vdp_hilightshadow_set(const bool enabled);
 
-*/
+/**
+ * \brief           Get if the shadow/highlight mode is on
+ * \return          true if the mode is on, false otherwise
+ */
+bool smd_vdp_hilightshadow_get(void);
+
+/**
+ * \brief           Set the VDP interlace mode
+ * \param           mode: New interlace mode
+ * \note            The change is done in the next vertical blank
+ */
+void smd_vdp_interlace_set(const smd_vdp_interlace_t mode);
+
+/**
+ * \brief           Get the VDP interlace mode
+ * \return          Current interlace mode
+ */
+smd_vdp_interlace_t smd_vdp_interlace_get(void);
+
+/**
+ * \brief           Get the field drawn in the current frame on interlace modes
+ * \return          0 on even fields, 1 on odd fields
+ * \note            The field is read on each vertical blank
+ */
+uint8_t smd_vdp_field_get(void);
+
+/**
+ * \brief           Update the current field on the vertical blank interrupt
+ * \note            Called from the vertical blank interrupt handler
+ */
+void smd_vdp_field_update(void);
 
 #ifdef __cplusplus
 }
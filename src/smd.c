@@ -18,12 +18,16 @@
 #include "../smd/src/null_data.c"
 #include "../smd/src/xgm_drv.c"
 #include "../smd/src/dma.c"
+#include "../smd/src/hud.c"
 #include "../smd/src/kdebug.c"
 #include "../smd/src/mem_utils.c"
 #include "../smd/src/pad.c"
 #include "../smd/src/pal.c"
+#include "../smd/src/perf.c"
 #include "../smd/src/plane.c"
 #include "../smd/src/psg.c"
+#include "../smd/src/raster.c"
+#include "../smd/src/scroll.c"
 #include "../smd/src/rand.c"
 #include "../smd/src/sprite.c"
 #include "../smd/src/text.c"
@@ -59,12 +59,16 @@
 #include "../smd/src/xgm_drv.h"
 #include "../smd/src/dma.h"
 #include "../smd/src/fix32.h"
+#include "../smd/src/hud.h"
 #include "../smd/src/kdebug.h"
 #include "../smd/src/mem_utils.h"
 #include "../smd/src/pad.h"
 #include "../smd/src/pal.h"
+#include "../smd/src/perf.h"
 #include "../smd/src/plane.h"
 #include "../smd/src/psg.h"
+#include "../smd/src/raster.h"
+#include "../smd/src/scroll.h"
 #include "../smd/src/rand.h"
 #include "../smd/src/sprite.h"
 #include "../smd/src/text.h"